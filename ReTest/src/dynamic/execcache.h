@@ -0,0 +1,169 @@
+#ifndef PCTRT_EXECCACHE_H
+#define PCTRT_EXECCACHE_H
+
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <nlohmann/json.hpp>
+
+#include "utils/common.h"
+#include "static/testcase.h"
+
+namespace PCTRT
+{
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/**
+ * ExecutionCache: 持久化的测试执行结果缓存
+ * 键为(插桩后可执行文件内容的哈希和执行方式, 测试输入的哈希), 值为执行得到的基本块覆盖情况。
+ * 可执行文件和输入都没有变化时, 测试用例不需要再执行一遍。
+ * 批量模式下静态状态会在用例之间保留, 结果可能与每个用例单独一个进程时不同, 所以执行方式也是键的一部分。
+ * 异常结束(超时、超出资源限制、崩溃)的结果与机器负载和资源限制有关, 不写入缓存, 下次运行时重新执行。
+ * 保存时只保留本次运行中用到的可执行文件对应的条目, 避免缓存文件无限增长。
+ * 同一个源文件的多个函数可以在不同的线程中共用一个缓存, 所有读写都加锁。
+ */
+class ExecutionCache {
+public:
+    struct Entry {
+        std::string result;     // 基本块覆盖情况
+        std::string status;     // 异常结束的原因, 缓存中的条目总是为空
+    };
+
+private:
+    std::string cacheFile;
+    std::unordered_map<std::string, Entry> entries;
+    std::unordered_set<std::string> usedBinaries;   // 本次运行中用到的可执行文件哈希
+    bool dirty {false};
+    std::mutex mtx;
+
+public:
+    explicit ExecutionCache(std::string file)
+        : cacheFile(std::move(file))
+        {
+            load();
+        }
+
+    ~ExecutionCache() = default;
+
+    static uint64_t fnv1a(const char* data, size_t size, uint64_t hash = FNV_OFFSET_BASIS){
+        for(size_t i = 0; i < size; ++i){
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+
+    static std::string toHex(uint64_t value){
+        char buf[17];
+        snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(value));
+        return buf;
+    }
+
+    // 计算可执行文件内容的哈希, 文件不存在时返回空字符串
+    static std::string hashFile(const std::string& file){
+        std::ifstream fin(file, std::ios::binary);
+        if(!fin){
+            return "";
+        }
+        uint64_t hash = FNV_OFFSET_BASIS;
+        char buffer[64 * 1024];
+        while(fin.read(buffer, sizeof(buffer)) || fin.gcount() > 0){
+            hash = fnv1a(buffer, static_cast<size_t>(fin.gcount()), hash);
+        }
+        return toHex(hash);
+    }
+
+    // 可执行文件在缓存中的标识: 文件内容的哈希加上执行方式, 文件不存在时返回空字符串
+    static std::string binaryKey(const std::string& exeFile, bool batch){
+        std::string hash = hashFile(exeFile);
+        if(hash.empty()){
+            return "";
+        }
+        return hash + (batch ? "-batch" : "-each");
+    }
+
+    // 输入按"类型\0数值\0"依次序列化后计算哈希
+    static std::string hashInputs(const TestCase& tc){
+        uint64_t hash = FNV_OFFSET_BASIS;
+        for(const auto& input : tc.inputs){
+            hash = fnv1a(input.type.c_str(), input.type.size() + 1, hash);
+            hash = fnv1a(input.data.c_str(), input.data.size() + 1, hash);
+        }
+        return toHex(hash);
+    }
+
+    bool lookup(const std::string& binaryHash, const TestCase& tc, Entry& entry){
+        if(binaryHash.empty()){
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        usedBinaries.insert(binaryHash);
+        auto it = entries.find(binaryHash + ":" + hashInputs(tc));
+        if(it == entries.end() || !it->second.status.empty()){
+            return false;
+        }
+        entry = it->second;
+        return true;
+    }
+
+    void store(const std::string& binaryHash, const TestCase& tc, Entry entry){
+        if(binaryHash.empty() || !entry.status.empty()){
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        usedBinaries.insert(binaryHash);
+        entries[binaryHash + ":" + hashInputs(tc)] = std::move(entry);
+        dirty = true;
+    }
+
+    bool save(){
+        std::lock_guard<std::mutex> lock(mtx);
+        if(!dirty && usedBinaries.empty()){
+            return true;
+        }
+        nlohmann::ordered_json j = nlohmann::ordered_json::object();
+        for(const auto& [key, entry] : entries){
+            if(usedBinaries.count(key.substr(0, key.find(':'))) == 0 || !entry.status.empty()){
+                continue;
+            }
+            j[key] = {{"result", entry.result}, {"status", entry.status}};
+        }
+        std::ofstream fout(cacheFile);
+        if(!fout){
+            std::cout << "Cannot write execution cache file: " << cacheFile << std::endl;
+            return false;
+        }
+        fout << j.dump(2);
+        fout.close();
+        dirty = false;
+        return true;
+    }
+
+private:
+    void load(){
+        if(!fileExists(cacheFile.c_str())){
+            return;
+        }
+        std::ifstream fin(cacheFile);
+        auto j = nlohmann::json::parse(fin, nullptr, false);
+        if(j.is_discarded() || !j.is_object()){
+            std::cout << "Ignore broken execution cache file: " << cacheFile << std::endl;
+            return;
+        }
+        for(const auto& [key, value] : j.items()){
+            Entry entry;
+            entry.result = value.value("result", "");
+            entry.status = value.value("status", "");
+            entries.emplace(key, std::move(entry));
+        }
+    }
+};
+
+} // namespace PCTRT
+
+#endif //PCTRT_EXECCACHE_H
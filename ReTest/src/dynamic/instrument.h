@@ -4,15 +4,131 @@
 #include <memory>
 #include <utility>
 #include <string>
+#include <vector>
+#include <unordered_map>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Dominators.h>
 
 #include "utils/common.h"
 
 namespace PCTRT
 {
 
+enum class PROBE_MODE {
+    PROBE_ALL,      // 每个基本块都插桩
+    PROBE_MINIMAL,  // 只在覆盖情况无法由其他基本块推导出的基本块中插桩
+};
+
+/**
+ * ProbePlan: 最小探针放置方案
+ * 基本块的覆盖情况在以下两种情况下可以由其他基本块推导出来, 这些基本块不需要插桩:
+ * 1. CHAIN: 基本块B只有唯一前驱P, 且P只有唯一后继B, 则B被覆盖当且仅当P被覆盖;
+ * 2. SUCCESSORS: B的所有后继都被B支配, 则B被覆盖当且仅当某个后继被覆盖。
+ * 两种推导都沿着支配树的边进行(CHAIN从子节点到父节点, SUCCESSORS从父节点到子节点),
+ * 只要禁止同一条边上的双向推导, 推导关系就不会成环。
+ * 推导假设被执行的基本块都会执行到它的终结指令, 进程在基本块中间崩溃时推导出的覆盖情况可能不准确。
+ */
+class ProbePlan {
+private:
+    enum class SOURCE {
+        SOURCE_PROBE,       // 需要插桩
+        SOURCE_CHAIN,       // 由唯一前驱推导
+        SOURCE_SUCCESSORS,  // 由被支配的后继推导
+    };
+
+    std::vector<SOURCE> sources;
+    std::vector<std::vector<int>> deps;     // 推导所依赖的基本块
+    size_t probes {0};
+
+public:
+    explicit ProbePlan(llvm::Function& function) {
+        std::unordered_map<const llvm::BasicBlock*, int> blockIds;
+        for(auto& block : function){
+            int id = static_cast<int>(blockIds.size());
+            blockIds[&block] = id;
+        }
+        sources.resize(blockIds.size(), SOURCE::SOURCE_PROBE);
+        deps.resize(blockIds.size());
+        llvm::DominatorTree DT(function);
+        for(auto& block : function){
+            int id = blockIds[&block];
+            auto pred = block.getUniquePredecessor();
+            if(DT.isReachableFromEntry(&block) && pred != nullptr && pred->getUniqueSuccessor() == &block){
+                sources[id] = SOURCE::SOURCE_CHAIN;
+                deps[id].push_back(blockIds[pred]);
+            }
+        }
+        for(auto& block : function){
+            int id = blockIds[&block];
+            if(sources[id] != SOURCE::SOURCE_PROBE || !DT.isReachableFromEntry(&block)){
+                continue;
+            }
+            std::vector<int> succIds;
+            bool derivable = succ_begin(&block) != succ_end(&block);
+            for(auto succ : successors(&block)){
+                int succId = blockIds[succ];
+                // 后继必须被当前基本块严格支配, 且不能反过来由当前基本块推导
+                if(succ == &block || !DT.dominates(&block, succ) || sources[succId] == SOURCE::SOURCE_CHAIN){
+                    derivable = false;
+                    break;
+                }
+                succIds.push_back(succId);
+            }
+            if(derivable){
+                sources[id] = SOURCE::SOURCE_SUCCESSORS;
+                deps[id] = std::move(succIds);
+            }
+        }
+        for(auto source : sources){
+            probes += source == SOURCE::SOURCE_PROBE;
+        }
+    }
+
+    [[nodiscard]] bool needsProbe(int blockId) const {
+        PCTRT_ASSERT(blockId >= 0 && blockId < sources.size(), "Block id is out of range.");
+        return sources[blockId] == SOURCE::SOURCE_PROBE;
+    }
+
+    [[nodiscard]] size_t getProbeCount() const {
+        return probes;
+    }
+
+    // 根据插桩基本块的覆盖情况还原完整的节点掩码
+    [[nodiscard]] std::string reconstruct(const std::string& probedMask) const {
+        if(probedMask.size() != sources.size()){
+            return probedMask;
+        }
+        std::vector<signed char> memo(sources.size(), -1);
+        std::string ret(sources.size(), '0');
+        for(int i = 0; i < sources.size(); ++i){
+            ret[i] = isCovered(i, probedMask, memo) ? '1' : '0';
+        }
+        return ret;
+    }
+
+private:
+    bool isCovered(int blockId, const std::string& probedMask, std::vector<signed char>& memo) const {
+        if(memo[blockId] >= 0){
+            return memo[blockId] == 1;
+        }
+        bool covered = false;
+        if(sources[blockId] == SOURCE::SOURCE_PROBE){
+            covered = probedMask[blockId] == '1';
+        }else{
+            for(int dep : deps[blockId]){
+                if(isCovered(dep, probedMask, memo)){
+                    covered = true;
+                    break;
+                }
+            }
+        }
+        memo[blockId] = covered ? 1 : 0;
+        return covered;
+    }
+};
+
 class IRPathMarker {
 private:
     std::unique_ptr<llvm::Module> module;
@@ -24,20 +140,28 @@ private:
     llvm::ArrayType* CharArrayTy {nullptr};
     llvm::LLVMContext* context {nullptr};
     llvm::GlobalVariable* charArray {nullptr};  // 全局的char数组
+    PROBE_MODE probeMode {PROBE_MODE::PROBE_ALL};
 
 public:
-    explicit IRPathMarker(std::unique_ptr<llvm::Module> mod, std::string funcName)
+    explicit IRPathMarker(std::unique_ptr<llvm::Module> mod, std::string funcName,
+                          PROBE_MODE mode = PROBE_MODE::PROBE_ALL)
         : module(std::move(mod))
         , cnt(0)
         , functionName(std::move(funcName))
+        , probeMode(mode)
         {}
 
     ~IRPathMarker() = default;
 
     void run() {
+        // 驱动文件中已经声明了__block_marker__时, 由驱动自己负责重置和输出
+        bool driverOwnsMarker = module->getNamedGlobal("__block_marker__") != nullptr;
         initialize();
         instrumentInTargetFunction();
-        instrumentInMainFunction();
+        if(!driverOwnsMarker){
+            instrumentInMainFunction();
+        }
+        removeOptNone();
     }
 
     void initialize(){
@@ -63,13 +187,27 @@ public:
         );
         charArray->setDSOLocal(true);
         charArray->setAlignment(llvm::Align(1));
+        // 用定义替换驱动中的extern声明
+        if(auto declaration = module->getNamedGlobal("__block_marker__"); declaration && declaration != charArray){
+            declaration->replaceAllUsesWith(llvm::ConstantExpr::getBitCast(charArray, declaration->getType()));
+            charArray->takeName(declaration);
+            declaration->eraseFromParent();
+        }
     }
 
     void instrumentInTargetFunction() {
         auto function = module->getFunction(functionName);
+        std::unique_ptr<ProbePlan> plan;
+        if(probeMode == PROBE_MODE::PROBE_MINIMAL){
+            plan = std::make_unique<ProbePlan>(*function);
+        }
         int idx = 0;
         // 在每个block中插桩
         for (auto& block : *function) {
+            if(plan && !plan->needsProbe(idx)){
+                idx++;
+                continue;
+            }
             // 在第一个instruction前插入指令
             llvm::IRBuilder<> irBuilder(&*block.getFirstInsertionPt());
             // 获取字符数组地址, 并store
@@ -112,6 +250,18 @@ public:
         }
     }
 
+    // clang在-O0下会给所有函数加上optnone和noinline, 导致插桩后的IR即使以-O2链接也不会被优化。
+    // 插桩在优化之前完成, 基本块编号与未优化IR构造的CFG一致; __block_marker__是外部可见的全局变量,
+    // 且在main返回前被printf读取, 所以对它的写入不会被优化删除。
+    void removeOptNone(){
+        for(auto& func : *module){
+            if(func.hasFnAttribute(llvm::Attribute::OptimizeNone)){
+                func.removeFnAttr(llvm::Attribute::OptimizeNone);
+                func.removeFnAttr(llvm::Attribute::NoInline);
+            }
+        }
+    }
+
     void print(){
         module->print(llvm::outs(), nullptr);
     }
@@ -7,6 +7,11 @@
 #include "utils/common.h"
 #include "static/cfg.h"
 #include "dynamic/testengine.h"
+#include "dynamic/execcache.h"
+#include "utils/modulecache.h"
+#include "static/cfgcache.h"
+#include "static/compactsuite.h"
+#include "static/suiteindex.h"
 
 namespace PCTRT {
 
@@ -130,6 +135,41 @@ private:
     }
 };
 
+/**
+ * SimilarityCache: 进程内共享的路径相似度结果
+ * 相似度只取决于新旧两个版本的IR和函数, 按(旧版本IR, 新版本IR, 各自的修改时间, 函数名)缓存,
+ * 常驻进程中对同一对版本的后续请求不再重新计算。不同线程构建的CFG路径编号相同, 结果可以跨线程共用。
+ */
+class SimilarityCache {
+public:
+    using PathMap = std::unordered_map<int, std::pair<int, double>>;
+
+private:
+    inline static std::mutex mtx;
+    inline static std::map<std::string, PathMap> results;
+
+public:
+    static std::string key(const std::string& oldIrFile, const std::string& newIrFile, const std::string& funcName){
+        return oldIrFile + "\n" + std::to_string(ModuleCache::modifyTime(oldIrFile)) + "\n"
+             + newIrFile + "\n" + std::to_string(ModuleCache::modifyTime(newIrFile)) + "\n" + funcName;
+    }
+
+    static bool lookup(const std::string& key, PathMap& pathMap){
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = results.find(key);
+        if(it == results.end()){
+            return false;
+        }
+        pathMap = it->second;
+        return true;
+    }
+
+    static void store(const std::string& key, const PathMap& pathMap){
+        std::lock_guard<std::mutex> lock(mtx);
+        results[key] = pathMap;
+    }
+};
+
 class ReuseEngine {
 private:
     std::string oldSrcFile;
@@ -146,82 +186,127 @@ private:
     std::unordered_map<int, std::pair<int, double>> path_map;
 
     std::unique_ptr<TestEngine> tester;
+    std::shared_ptr<ExecutionCache> cache;  // 新旧版本共用的执行结果缓存, 可以由多个函数共用
+    std::string newTestSuiteJsonFile;       // 新版本测试套件的输出文件
 
     std::vector<int> executedOldPaths;
     std::vector<int> executedNewPaths;
 
+    RuntimeOptions options;
+
 public:
     ReuseEngine() = default;
     ~ReuseEngine() = default;
 
+    void setOptions(const RuntimeOptions& opts){
+        this->options = opts;
+    }
+
+    // 使用外部的执行结果缓存(例如同一个源文件的多个函数共用一个缓存), 之后reuseTestSuite不再按测试套件文件创建缓存
+    void setCache(std::shared_ptr<ExecutionCache> executionCache){
+        this->cache = std::move(executionCache);
+    }
+
+    // 指定新版本测试套件的输出文件, 不指定时输出到测试套件文件旁边的<测试套件名>_reused.json(.pcts), 格式与测试套件相同
+    void setOutputFile(const std::string& file){
+        this->newTestSuiteJsonFile = file;
+    }
+
+    [[nodiscard]] const std::string& getOutputFile() const {
+        return newTestSuiteJsonFile;
+    }
+
+    // 新版本的执行引擎, reuseTestSuite之后才有效
+    TestEngine* getTester(){
+        return tester.get();
+    }
+
     void init() {
         // 1. 编译旧版本的源文件
         auto oldIrFile = getDirPath(oldSrcFile) + getBaseName(oldSrcFile) + ".ll";
-        compileSrcToIR(oldSrcFile, oldIrFile);
+        ModuleCache::compile(oldSrcFile, oldIrFile);
         // 2. 编译新版本的源文件
         auto newIrFile = getDirPath(newSrcFile) + getBaseName(newSrcFile) + ".ll";
-        compileSrcToIR(newSrcFile, newIrFile);
+        ModuleCache::compile(newSrcFile, newIrFile);
     }
 
     bool initCFG(){
-        // 1. 获取旧版本的CFG
-        old_cfg = std::make_shared<CFG>();
-        std::string old_ir_file = getDirPath(oldSrcFile) + getBaseName(oldSrcFile) + ".ll";
-        // 从旧版本IR解析llvm::Module
-        llvm::LLVMContext ctx;
-        llvm::SMDiagnostic err;
-        auto ptr = llvm::parseIRFile(old_ir_file, err, ctx);
-        if(!ptr){
-            std::cout << "Parse IR file" << old_ir_file << " failed" << std::endl;
-            return false;
-        }
-        old_cfg->initGraphFromFunction(ptr->getFunction(funcName));
-        old_cfg->getInfoFromSrcFile(oldSrcFile);
+        // 1. 获取旧版本的CFG, 同一线程中已经构建过的直接复用
+        old_cfg = CFGCache::get(getDirPath(oldSrcFile) + getBaseName(oldSrcFile) + ".ll", oldSrcFile, funcName);
         // 2. 获取新版本的CFG
-        new_cfg = std::make_shared<CFG>();
-        std::string new_ir_file = getDirPath(newSrcFile) + getBaseName(newSrcFile) + ".ll";
-        // 从新版本IR解析llvm::Module
-        ptr = llvm::parseIRFile(new_ir_file, err, ctx);
-        if(!ptr){
-            std::cout << "Parse IR file" << new_ir_file << " failed" << std::endl;
-            return false;
-        }
-        new_cfg->initGraphFromFunction(ptr->getFunction(funcName));
-        new_cfg->getInfoFromSrcFile(newSrcFile);
-        return true;
+        new_cfg = CFGCache::get(getDirPath(newSrcFile) + getBaseName(newSrcFile) + ".ll", newSrcFile, funcName);
+        return old_cfg && new_cfg;
     }
 
-    void setSrcAndFunction(const std::string& oldSrc, const std::string& newSrc, const std::string& func){
+    bool setSrcAndFunction(const std::string& oldSrc, const std::string& newSrc, const std::string& func){
         this->oldSrcFile = oldSrc;
         this->newSrcFile = newSrc;
         this->funcName = func;
         init();
-        initCFG();
-        calculator = std::make_unique<SimilarityCalculator>(old_cfg, new_cfg, funcName);
-        calculator->run(path_map);  // 计算新版本CFG的路径与旧版本CFG路径的相似度存放到path_map中
+        if(!initCFG()){
+            return false;
+        }
+        // 计算新版本CFG的路径与旧版本CFG路径的相似度存放到path_map中, 同一对版本只计算一次
+        std::string simKey = SimilarityCache::key(getDirPath(oldSrcFile) + getBaseName(oldSrcFile) + ".ll",
+                                                  getDirPath(newSrcFile) + getBaseName(newSrcFile) + ".ll", funcName);
+        path_map.clear();
+        if(!SimilarityCache::lookup(simKey, path_map)){
+            calculator = std::make_unique<SimilarityCalculator>(old_cfg, new_cfg, funcName);
+            calculator->run(path_map);
+            SimilarityCache::store(simKey, path_map);
+        }
+        return true;
     }
 
     std::vector<bool> reuseTestSuite(const std::string& testSuiteJsonFile, TestSuite& new_suite){
-        old_suite = getTestSuiteFromFile(testSuiteJsonFile.c_str());
-        if(!old_suite.isExecuted()){
-            //如果没执行过，就执行一遍
-            tester = std::make_unique<TestEngine>(oldSrcFile, funcName);
+        if(!cache){
+            initCache(testSuiteJsonFile);
+        }
+        // 测试套件已经在同一个旧版本上执行过时, 流式读取其中记录的pathId, 只解码被复用的测试用例
+        SuiteIndex index;
+        bool indexed = fileExists(testSuiteJsonFile) && index.open(testSuiteJsonFile) && isExecutedOnOldVersion(index.getMeta());
+        if(indexed){
+            std::cout << "Test suite was executed on the same old version, reuse its path ids" << std::endl;
+            const auto& refs = index.getCases();
+            int old_path_size = static_cast<int>(old_cfg->getPaths().size());
+            for(int i = 0; i < refs.size(); ++i){
+                if(!refs[i].abnormal && refs[i].pathId >= 0 && refs[i].pathId < old_path_size){
+                    path_test_map[refs[i].pathId].push_back(i);
+                }
+            }
+        }else{
+            old_suite = loadTestSuite(testSuiteJsonFile);
+            // 旧版本的测试用例经过执行引擎, 命中缓存的测试用例不会真正执行
+            tester = std::make_unique<TestEngine>(oldSrcFile, funcName, options);
+            tester->setCache(cache.get());
             tester->setDriverFile();
             std::vector<std::string> test_results;
             tester->run(old_suite, test_results);
+            old_cfg->resetMatchState();
             for(int i = 0; i < test_results.size(); ++i){
+                if(old_suite.getTestCase(i).isAbnormal()){
+                    continue;
+                }
                 int old_path_id = old_cfg->matchBestPathId(test_results[i]);
                 if(old_path_id != INVALID_PATH_ID){
                     path_test_map[old_path_id].push_back(i);
                 }
             }
-        }else{
-            int old_suite_size = static_cast<int>(old_suite.getTestCases().size());
-            for(int i = 0; i < old_suite_size; ++i){
-                int old_path_id = old_suite.getTestCase(i).getPathId();
-                path_test_map[old_path_id].push_back(i);
-            }
         }
+        // 旧版本的测试套件在挑选之后不再使用, 最后一次用到的测试用例直接移入新的测试套件
+        auto oldTestCase = [&](int test_id, bool lastUse) -> TestCase {
+            if(!indexed){
+                PCTRT_ASSERT(test_id >= 0 && test_id < old_suite.testCases.size(), "TestCase index out of range.");
+                if(lastUse){
+                    return std::move(old_suite.testCases[test_id]);
+                }
+                return old_suite.testCases[test_id];
+            }
+            TestCase tc;
+            bool loaded = index.getTestCase(test_id, tc);
+            PCTRT_ASSERT(loaded, "Cannot read test case from test suite file.");
+            return tc;
+        };
         // 打印新版程序的CFG路径
         int new_path_size = new_cfg->getPaths().size();
         for(int i = 0; i < new_path_size; ++i){
@@ -252,13 +337,16 @@ public:
             }
         }
         for(const auto& test_id : reused_test_ids){
-            new_suite.addTestCase(old_suite.getTestCase(test_id));
+            new_suite.addTestCase(oldTestCase(test_id, reused_without_exep_test_ids.count(test_id) == 0));
         }
         for(const auto& test_id : reused_without_exep_test_ids){
-            new_suite.addTestCaseWithoutExpectation(old_suite.getTestCase(test_id));
+            new_suite.addTestCaseWithoutExpectation(oldTestCase(test_id, true));
+        }
+        old_suite = TestSuite();
+        if(newTestSuiteJsonFile.empty()){
+            newTestSuiteJsonFile = getDirPath(testSuiteJsonFile) + getNakedName(testSuiteJsonFile) + "_reused" + suiteExtension(testSuiteJsonFile);
         }
-        std::string newTestSuiteJsonFile = getDirPath(testSuiteJsonFile) + getNakedName(testSuiteJsonFile) + "_reused.json";
-        executeNewTestsuite(new_suite, newTestSuiteJsonFile);
+        executeNewTestsuite(new_suite);
 
         // 统计路径覆盖情况
         std::vector<bool> oldPathCoverInfo, newPathCoverInfo;
@@ -274,6 +362,25 @@ public:
         return newPathCoverInfo;
     }
 
+    // 测试套件是否已经在当前的旧版本上执行过: 记录的源文件哈希与旧版本一致时, 其中的pathId与旧版本的CFG对应
+    bool isExecutedOnOldVersion(const TestSuite& meta) const {
+        return meta.isExecuted() && meta.getFuncName() == funcName && !meta.getSrcHash().empty()
+               && meta.getSrcHash() == ExecutionCache::hashFile(oldSrcFile);
+    }
+
+    // 缓存文件默认放在测试套件文件旁边, 指定为"none"时不使用缓存
+    void initCache(const std::string& testSuiteJsonFile){
+        if(options.execCacheFile == "none"){
+            cache.reset();
+            return;
+        }
+        std::string cacheFile = options.execCacheFile;
+        if(cacheFile.empty()){
+            cacheFile = getDirPath(testSuiteJsonFile) + getNakedName(testSuiteJsonFile) + "_exec_cache.json";
+        }
+        cache = std::make_shared<ExecutionCache>(cacheFile);
+    }
+
     bool compileDriverAndInstrument(std::string driverFile, std::string functionName){
         // 将驱动文件编译为IR文件
         if(!fileExists(driverFile.c_str())){
@@ -301,18 +408,41 @@ public:
         }
         // 将IR文件编译为可执行文件
         std::string exeFile = getDirPath(driverFile) + getBaseName(driverFile) + "_instrumented";
-        if(!compileIRToExec(irInstrumentedFile, exeFile)){
+        if(!compileIRToExec(irInstrumentedFile, exeFile, options.optimizeExec)){
             return false;
         }
         return true;
     }
 
-    void executeNewTestsuite(TestSuite& newSuite, const std::string& newTestSuiteJsonFile){
-        tester = std::make_unique<TestEngine>(newSrcFile, funcName);
+    void executeNewTestsuite(TestSuite& newSuite){
+        tester = std::make_unique<TestEngine>(newSrcFile, funcName, options);
+        tester->setCache(cache.get());
         tester->setDriverFile();
         std::vector<std::string> test_results;
         tester->run(newSuite, test_results);
-        dumpTestSuiteToFile(newSuite, newTestSuiteJsonFile);
+    }
+
+    // 把生成的测试用例追加到复用得到的测试套件中, 重新计算路径覆盖情况(复用的测试用例命中缓存, 不会再执行)
+    void addGeneratedTestCases(TestSuite& newSuite, TestSuite&& generated){
+        newSuite.setInfeasiblePaths(generated.getInfeasiblePaths());
+        if(generated.testCases.empty()){
+            return;
+        }
+        for(auto& tc : generated.testCases){
+            newSuite.addTestCase(std::move(tc));
+        }
+        generated.testCases.clear();
+        std::vector<std::string> test_results;
+        tester->run(newSuite, test_results);
+    }
+
+    // 输出新版本的测试套件, 复用和生成的测试用例一起写入
+    void dumpNewTestSuite(const TestSuite& newSuite){
+        if(cache){
+            cache->save();
+        }
+        dumpTestSuite(newSuite, newTestSuiteJsonFile);
+        std::cout << "Test suite with " << newSuite.testCases.size() << " test cases written to " << newTestSuiteJsonFile << std::endl;
     }
 
     // 输出测试用例复用的报告
@@ -2,16 +2,21 @@
 #define PCTRT_TESTENGINE_H
 
 #include <vector>
-#include <thread>
 #include <unistd.h>
 #include <iostream>
 #include <string>
 #include <cstdio>
+#include <cstring>
+#include <csignal>
 #include <algorithm>
 #include "utils/common.h"
+#include "utils/process.h"
+#include "utils/modulecache.h"
 #include "instrument.h"
+#include "execcache.h"
 #include "static/testcase.h"
 #include "static/cfg.h"
+#include "static/cfgcache.h"
 
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IRReader/IRReader.h>
@@ -21,119 +26,54 @@
 namespace PCTRT
 {
 
-class ConcurrentExecutor {
+// 基于ProcessPool的执行器: 直接以argv启动测试进程, 并发数默认等于CPU核数
+class SpawnExecutor {
 private:
-    struct Task {
-        std::string command;
-        size_t resultIndex{};
-    };
-
-    const size_t maxThreads = 50;
-    std::vector<std::string> results;
-    std::vector<std::thread> threads;
-    std::list<Task> tasks;
-    std::mutex mtx;
+    std::vector<std::vector<std::string>> argvs;
+    std::vector<ProcessResult> results;
+    size_t parallel;
+    ProcessLimits limits;
 
 public:
-    explicit ConcurrentExecutor(const std::vector<std::string>& cmds) {
-        for(size_t i = 0; i < cmds.size(); ++i) {
-            tasks.push_back({cmds[i], i});
-        }
-        results.resize(cmds.size());
-    }
-
-    ~ConcurrentExecutor() {
-        for (auto &thread : threads){
-            if (thread.joinable()){
-                thread.join();
-            }
+    explicit SpawnExecutor(std::vector<std::vector<std::string>> argvs, size_t parallel = 0,
+                           const ProcessLimits& limits = {})
+        : argvs(std::move(argvs))
+        , parallel(parallel)
+        , limits(limits)
+        {
+            results.resize(this->argvs.size());
         }
-    }
 
     void execute() {
-        size_t threadCount = std::min(tasks.size(), maxThreads);
-        threads.resize(threadCount);
-        for(auto& thread : threads) {
-            thread = std::thread(&ConcurrentExecutor::threadFunc, this);
+        ProcessPool pool(parallel);
+        for(size_t i = 0; i < argvs.size(); ++i){
+            pool.submit(std::move(argvs[i]), [this, i](size_t, ProcessResult& result){
+                results[i] = std::move(result);
+            }, limits);
         }
+        pool.wait();
     }
 
     std::vector<std::string> getResults(){
-        for (auto &thread : threads){
-            if (thread.joinable()){
-                thread.join();
-            }
-        }
-        return results;
-    }
-
-private:
-    void threadFunc() {
-        while(true) {
-            Task task;
-            // Get the next task
-            {
-                std::lock_guard<std::mutex> lock(mtx);
-                if(tasks.empty())
-                    return;
-                task = tasks.front();
-                tasks.pop_front();
-            }
-
-            // Execute and write the results
-            executeAndGetResults(task.command, results[task.resultIndex]);
+        std::vector<std::string> outputs;
+        outputs.reserve(results.size());
+        for(const auto& result : results){
+            outputs.push_back(result.output);
         }
+        return outputs;
     }
 
-    static void executeAndGetResults(const std::string& command, std::string& result){
-        FILE *pipe = popen(command.c_str(), "r");
-        if (!pipe) {
-            std::cout << "Cannot execute command: " << command << std::endl;
-            return;
-        }
-        char buffer[128];
-        while (!feof(pipe)) {
-            if(fgets(buffer, 128, pipe) != nullptr) {
-                result += buffer;
-            }
+    // 取走每个进程的输出, 之后getProcessResults中的输出为空, 其余字段不变
+    std::vector<std::string> takeResults(){
+        std::vector<std::string> outputs;
+        outputs.reserve(results.size());
+        for(auto& result : results){
+            outputs.push_back(std::move(result.output));
         }
-        pclose(pipe);
+        return outputs;
     }
-};
 
-class SequentialExecutor {
-private:
-    std::vector<std::string> cmds;
-    std::vector<std::string> results;
-
-    void executeAndGetResults(const std::string& command, std::string& result) {
-        FILE *pipe = popen(command.c_str(), "r");
-        if (!pipe) {
-            std::cout << "Cannot execute command: " << command << std::endl;
-            return;
-        }
-        char buffer[128];
-        while (!feof(pipe)) {
-            if(fgets(buffer, 128, pipe) != nullptr) {
-                result += buffer;
-            }
-        }
-        pclose(pipe);
-    }
-
-public:
-    explicit SequentialExecutor(const std::vector<std::string>& cmds) {
-        this->cmds = cmds;
-        results.resize(cmds.size());
-    }
-
-    void execute() {
-        for(int i = 0; i < cmds.size(); ++i){
-            executeAndGetResults(cmds[i], results[i]);
-        }
-    }
-
-    std::vector<std::string> getResults(){
+    [[nodiscard]] const std::vector<ProcessResult>& getProcessResults() const {
         return results;
     }
 };
@@ -143,19 +83,24 @@ private:
     std::string srcFile;        // 待测源文件
     std::string irFile;         // 待测源文件对应的IR文件
     std::string functionName;   // 待测函数名
-    CFG cfg;                    // 待测函数的CFG
+    std::shared_ptr<CFG> cfg;   // 待测函数的CFG, 同一线程中按函数共用
 
     std::string driverFile;     // 生成的驱动文件
     std::string irInstrumentedFile; // 添加了路径标记的IR文件
     std::string exeFile;        // 生成的可执行文件
+    RuntimeOptions options;     // 运行时选项
+    std::unique_ptr<ProbePlan> probePlan;   // 最小插桩模式下用于还原覆盖情况
+    std::vector<std::pair<std::string, std::string>> parameters;    // 待测函数的参数(类型, 名称)
+    bool forkPerCase {false};   // 批量模式下每个测试用例在单独的子进程中执行(源文件有可写的静态状态时)
 
-//    std::unique_ptr<ConcurrentExecutor> executor;
-    std::unique_ptr<SequentialExecutor> executor;
+    std::unique_ptr<SpawnExecutor> executor;
+    ExecutionCache* cache {nullptr};   // 执行结果缓存, 由调用者持有
 
 public:
-    TestEngine(const std::string& srcfile, const std::string& function) {
+    TestEngine(const std::string& srcfile, const std::string& function, const RuntimeOptions& opts = {}) {
         this->srcFile = srcfile;
         this->functionName = function;
+        this->options = opts;
         init();
         initCFG();
     }
@@ -163,7 +108,11 @@ public:
     ~TestEngine() = default;
 
     CFG& getCFG(){
-        return cfg;
+        return *cfg;
+    }
+
+    void setCache(ExecutionCache* executionCache){
+        this->cache = executionCache;
     }
 
     void setDriverFile(const std::string& driver) {
@@ -172,19 +121,22 @@ public:
     }
 
     void setDriverFile(){
-        this->driverFile = getDirPath(srcFile) + getBaseName(srcFile) + "_driver.c";
+        auto driverType = options.batchDriver ? DRIVER_TYPE::DRIVER_BATCH : DRIVER_TYPE::DRIVER_EXECUTABLE;
+        this->driverFile = DriverGenerator::getDriverFile(srcFile, functionName, driverType);
         compileDriverAndInstrument();
     }
 
     bool init(){
         // 将源文件编译成IR文件
         irFile = getDirPath(srcFile) + getBaseName(srcFile) + ".ll";
-        if(!compileSrcToIR(srcFile, irFile)){
+        if(!ModuleCache::compile(srcFile, irFile)){
             return false;
         }
         // 添加驱动函数文件
         DriverGenerator driverGenerator(srcFile);
-        auto driverFile = driverGenerator.generate(functionName, DRIVER_TYPE::DRIVER_EXECUTABLE);
+        auto driverType = options.batchDriver ? DRIVER_TYPE::DRIVER_BATCH : DRIVER_TYPE::DRIVER_EXECUTABLE;
+        auto driverFile = driverGenerator.generate(functionName, driverType);
+        parameters = driverGenerator.getParameters(functionName);
         if(driverFile.empty()){
             std::cout << "Generate driver file failed, please input executable diver file name:" << std::endl;
             std::cin >> driverFile;
@@ -197,20 +149,23 @@ public:
     }
 
     bool initCFG(){
-        llvm::LLVMContext ctx;
-        llvm::SMDiagnostic err;
-        auto ptr = llvm::parseIRFile(irFile, err, ctx);
-        if(!ptr){
-            std::cout << "Parse IR file " << irFile <<  " failed" << std::endl;
+        llvm::Module* module = ModuleCache::get(irFile);
+        if(!module){
             return false;
         }
-        llvm::Function* function = ptr->getFunction(functionName);
+        llvm::Function* function = module->getFunction(functionName);
         if(!function){
             std::cout << "Cannot find target function in module." << std::endl;
             return false;
         }
-        cfg.initGraphFromFunction(function);
-        cfg.getInfoFromSrcFile(srcFile);
+        cfg = CFGCache::get(irFile, srcFile, functionName);
+        if(options.batchDriver && hasWritableStatics(*module)){
+            forkPerCase = true;
+            std::cout << "Source file has writable static state, batch driver forks for each test case." << std::endl;
+        }
+        if(options.minimalProbes){
+            probePlan = std::make_unique<ProbePlan>(*function);
+        }
         return true;
     }
 
@@ -221,13 +176,14 @@ public:
             return false;
         }
         std::string irDriverFile = getDirPath(driverFile) + getBaseName(driverFile) + ".ll";
-        if(!compileSrcToIR(driverFile, irDriverFile)){
+        if(!ModuleCache::compile(driverFile, irDriverFile)){
             std::cout << "Compile driver file to llvm IR failed" << std::endl;
             return false;
         }
-        // 对IR文件进行插桩
-        this->irInstrumentedFile = getDirPath(driverFile) + getBaseName(driverFile) + "_instrumented.ll";
-        if(!fileExists(irInstrumentedFile.c_str())) {
+        // 对IR文件进行插桩, 两种插桩模式的文件分开存放; 驱动的IR没有变化时沿用上次插桩和编译的结果
+        std::string suffix = options.minimalProbes ? "_instrumented_min.ll" : "_instrumented.ll";
+        this->irInstrumentedFile = getDirPath(driverFile) + getBaseName(driverFile) + suffix;
+        if(!isUpToDate(irInstrumentedFile, irDriverFile)) {
             llvm::LLVMContext ctx;
             llvm::SMDiagnostic err;
             auto ptr = llvm::parseIRFile(irDriverFile, err, ctx);
@@ -235,31 +191,199 @@ public:
                 std::cout << "Parse IR file" << irDriverFile << " failed" << std::endl;
                 return false;
             }
-            IRPathMarker irPathMarker (std::move(ptr), functionName);
+            PROBE_MODE mode = options.minimalProbes ? PROBE_MODE::PROBE_MINIMAL : PROBE_MODE::PROBE_ALL;
+            IRPathMarker irPathMarker (std::move(ptr), functionName, mode);
             irPathMarker.run();
             irPathMarker.dumpToFile(irInstrumentedFile);
         }
         // 将IR文件编译为可执行文件
-        exeFile = getDirPath(irInstrumentedFile) + getBaseName(irInstrumentedFile);
-        if(!compileIRToExec(irInstrumentedFile, exeFile)){
+        exeFile = getDirPath(irInstrumentedFile) + getBaseName(irInstrumentedFile) + (options.optimizeExec ? "_O2" : "");
+        if(!isUpToDate(exeFile, irInstrumentedFile) && !compileIRToExec(irInstrumentedFile, exeFile, options.optimizeExec)){
             return false;
         }
         return true;
     }
 
+    // 执行测试套件并计算路径覆盖情况。
+    // 设置了缓存时, 可执行文件、执行方式和输入都没有变化的测试用例直接使用缓存的结果, 只执行其余的测试用例;
+    // 异常结束的结果不写入缓存;
+    // 结束后测试套件的executed标记为true, 表示每个测试用例的结果都对应当前的可执行文件
     void run(TestSuite& testSuite, std::vector<std::string>& outputs){
-        std::vector<std::string> cmds;
+        auto& testCases = testSuite.testCases;
+        std::string binaryHash = cache ? ExecutionCache::binaryKey(exeFile, options.batchDriver) : "";
+        outputs.assign(testCases.size(), "");
+        TestSuite pending;
+        std::vector<size_t> pendingIds;
+        for(size_t i = 0; i < testCases.size(); ++i){
+            ExecutionCache::Entry entry;
+            if(cache && cache->lookup(binaryHash, testCases[i], entry)){
+                outputs[i] = std::move(entry.result);
+                testCases[i].setStatus(std::move(entry.status));
+                continue;
+            }
+            // 待执行的测试用例暂时移到pending中, 执行后再移回
+            pendingIds.push_back(i);
+            pending.addTestCase(std::move(testCases[i]));
+        }
+        if(cache){
+            std::cout << "Execution cache: " << testCases.size() - pendingIds.size() << " hit, "
+                      << pendingIds.size() << " to execute" << std::endl;
+        }
+        if(!pendingIds.empty()){
+            std::vector<std::string> pendingOutputs;
+            execute(pending, pendingOutputs);
+            for(size_t k = 0; k < pendingIds.size(); ++k){
+                size_t i = pendingIds[k];
+                removeBlanks(pendingOutputs[k]);
+                outputs[i] = std::move(pendingOutputs[k]);
+                testCases[i] = std::move(pending.testCases[k]);
+                if(cache){
+                    cache->store(binaryHash, testCases[i], {outputs[i], testCases[i].status});
+                }
+            }
+        }
+        computeCoverage(testSuite, outputs, *cfg);
+        testSuite.setExecuted(true);
+        testSuite.setSrcHash(ExecutionCache::hashFile(srcFile));
+    }
+
+    // 实际执行测试用例, 得到还原后的基本块覆盖情况
+    void execute(TestSuite& testSuite, std::vector<std::string>& outputs){
+        for(auto& tc : testSuite.testCases){
+            tc.setStatus("");
+        }
+        if(options.batchDriver){
+            runBatch(testSuite, outputs);
+        }else{
+            runEach(testSuite, outputs);
+        }
+        if(probePlan){
+            for(auto& output : outputs){
+                removeBlanks(output);
+                output = probePlan->reconstruct(output);
+            }
+        }
+    }
+
+    // 每个测试用例启动一个进程, 输入通过命令行参数传递
+    void runEach(TestSuite& testSuite, std::vector<std::string>& outputs){
+        std::vector<std::vector<std::string>> argvs;
         for(auto& tc : testSuite.testCases){
-            std::string cmd = exeFile;
+            std::vector<std::string> argv = {exeFile};
             for(auto& arg : tc.inputs){
-                cmd += " \"" + arg.data + "\"";
+                argv.push_back(arg.data);
             }
-            cmds.push_back(cmd);
+            argvs.push_back(std::move(argv));
         }
-        executor = std::make_unique<SequentialExecutor>(cmds);
+        ProcessLimits limits;
+        limits.timeoutMs = options.execTimeoutMs;
+        limits.cpuSeconds = options.execCpuSeconds;
+        limits.memoryMB = options.execMemoryMB;
+        executor = std::make_unique<SpawnExecutor>(std::move(argvs), options.execParallel, limits);
         executor->execute();
-        outputs = executor->getResults();
-        computeCoverage(testSuite, outputs, cfg);
+        outputs = executor->takeResults();
+        const auto& results = executor->getProcessResults();
+        for(size_t i = 0; i < results.size(); ++i){
+            testSuite.testCases[i].setStatus(describeAbnormalExit(results[i].timedOut, results[i].termSignal));
+        }
+    }
+
+    // 测试用例按CPU核数分成若干段, 每段编码为一个二进制流, 由一个批量驱动进程依次执行。
+    // 进程中途崩溃时, 已输出记录之后的那个用例视为崩溃, 该段从下一个用例开始重新启动进程。
+    // 源文件有可写的静态状态时, 驱动为每个用例fork一个子进程, 结果与每个用例单独一个进程时相同。
+    void runBatch(TestSuite& testSuite, std::vector<std::string>& outputs){
+        auto& testCases = testSuite.testCases;
+        outputs.assign(testCases.size(), "");
+        size_t parallel = options.execParallel > 0 ? options.execParallel : ProcessPool::defaultParallelism();
+        size_t chunk = std::max<size_t>(BATCH_MIN_CASES, (testCases.size() + parallel - 1) / parallel);
+        std::vector<std::pair<size_t, size_t>> ranges;  // [begin, end)
+        for(size_t begin = 0; begin < testCases.size(); begin += chunk){
+            ranges.emplace_back(begin, std::min(testCases.size(), begin + chunk));
+        }
+        while(!ranges.empty()){
+            std::vector<std::vector<std::string>> argvs;
+            std::vector<std::string> streamFiles;
+            for(size_t r = 0; r < ranges.size(); ++r){
+                std::string stream;
+                for(size_t i = ranges[r].first; i < ranges[r].second; ++i){
+                    std::vector<std::string> args;
+                    for(const auto& arg : testCases[i].inputs){
+                        args.push_back(arg.data);
+                    }
+                    BatchCodec::encodeTestCase(parameters, args, stream);
+                }
+                std::string streamFile = exeFile + "_cases_" + std::to_string(r) + ".bin";
+                std::ofstream fout(streamFile, std::ios::binary);
+                fout.write(stream.data(), static_cast<std::streamsize>(stream.size()));
+                fout.close();
+                argvs.push_back({exeFile, streamFile, std::to_string(options.execCpuSeconds), forkPerCase ? "1" : "0"});
+                streamFiles.push_back(streamFile);
+            }
+            // 墙钟超时按输出计算: 批量驱动每执行完一个用例就输出一条记录;
+            // CPU时间由驱动按用例计时, RLIMIT_CPU只作为整个进程的兜底
+            ProcessLimits limits;
+            limits.idleTimeoutMs = options.execTimeoutMs;
+            limits.cpuSeconds = options.execCpuSeconds > 0 ? options.execCpuSeconds * static_cast<int>(chunk) + 1 : 0;
+            limits.memoryMB = options.execMemoryMB;
+            executor = std::make_unique<SpawnExecutor>(std::move(argvs), options.execParallel, limits);
+            executor->execute();
+            const auto& results = executor->getProcessResults();
+            std::vector<std::pair<size_t, size_t>> remaining;
+            for(size_t r = 0; r < ranges.size(); ++r){
+                auto [begin, end] = ranges[r];
+                std::vector<std::string> masks;
+                std::vector<int> status;
+                size_t done = std::min(BatchCodec::decodeRecords(results[r].output, masks, status), end - begin);
+                for(size_t i = 0; i < done; ++i){
+                    outputs[begin + i] = std::move(masks[i]);
+                    // 被测函数调用exit与单用例驱动在atexit中输出覆盖情况一样, 视为正常结束
+                    if(status[i] != 0 && status[i] != BATCH_STATUS_EXIT){
+                        bool timedOut = results[r].timedOut && status[i] == SIGTERM;
+                        testCases[begin + i].setStatus(describeAbnormalExit(timedOut, status[i]));
+                    }
+                }
+                // 最后一条记录不正常或调用了exit时, 该用例已经有覆盖记录, 进程已经结束; 否则下一个用例没有任何记录
+                size_t next = begin + done;
+                if(done > 0 && status[done - 1] != 0){
+                    if(status[done - 1] != BATCH_STATUS_EXIT){
+                        std::cout << "Batch driver stopped at testcase " << testCases[next - 1].toString() << std::endl;
+                    }
+                }else if(next < end){
+                    std::cout << "Batch driver stopped at testcase " << testCases[next].toString() << std::endl;
+                    testCases[next].setStatus(describeAbnormalExit(results[r].timedOut, results[r].termSignal));
+                    next++;
+                }
+                if(next < end){
+                    remaining.emplace_back(next, end);
+                }
+                std::remove(streamFiles[r].c_str());
+            }
+            ranges = std::move(remaining);
+        }
+    }
+
+    // 源文件中定义了非常量的全局变量或静态局部变量时, 同一进程中前面的用例可能影响后面的用例
+    static bool hasWritableStatics(const llvm::Module& module){
+        for(const auto& global : module.globals()){
+            if(!global.isDeclaration() && !global.isConstant()){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 把异常结束的原因转换为记录在TestCase::status中的描述
+    static std::string describeAbnormalExit(bool timedOut, int signal){
+        if(timedOut){
+            return "timeout";
+        }
+        if(signal == SIGXCPU || signal == SIGPROF){
+            return "cpu limit exceeded";
+        }
+        if(signal != 0){
+            return std::string("crashed: ") + strsignal(signal);
+        }
+        return "";
     }
 
     static void computeCoverage(TestSuite& testSuite, const std::vector<std::string>& outputs, CFG& cfg){
@@ -268,9 +392,15 @@ public:
 
         std::unordered_map<int, int> pathTestCnt;
         for(int i = 0; i < outputs.size(); ++i){
-            std::string output = outputs[i];
-            removeBlanks(output);
-            testCases[i].setResult(output);
+            testCases[i].setResult(outputs[i]);
+            removeBlanks(testCases[i].result);
+            const std::string& output = testCases[i].result;
+            // 异常结束的测试用例只记录部分覆盖情况, 不对应任何路径
+            if(testCases[i].isAbnormal()){
+                testCases[i].setPathId(INVALID_PATH_ID);
+                std::cout << "Testcase " << testCases[i].toString() << " " << testCases[i].status << ", partial coverage: " << output << std::endl;
+                continue;
+            }
 
             int pathId = cfg.matchPathId(output);
             if(pathId != INVALID_PATH_ID && pathTestCnt.count(pathId) == 0){
@@ -2,6 +2,9 @@
 #define PCTRT_DRIVERGENERATOR_H
 
 #include <string>
+#include <cstring>
+#include <climits>
+#include <sstream>
 #include "utils/common.h"
 
 namespace PCTRT {
@@ -9,6 +12,126 @@ namespace PCTRT {
 enum class DRIVER_TYPE {
     DRIVER_EXECUTABLE,
     DRIVER_KLEE_SE,
+    DRIVER_BATCH,
+};
+
+/**
+ * BatchCodec: 批量驱动的二进制输入输出格式(本机字节序)
+ * 输入流: 每个测试用例为 u32 用例字节数 + 按参数顺序排列的数据
+ *   int/uint32_t: 4字节; char: 1字节; int*: u32 元素个数 + 元素; char*: u32 长度 + 字符(不含'\0')
+ * 输出流: u32 基本块数目n, 之后每个测试用例一条记录: u8 状态 + (n+7)/8 字节的覆盖位图(低位在前)
+ *   状态为0表示正常结束, 否则为终止测试用例的信号值, 被测函数调用exit时为BATCH_STATUS_EXIT
+ *   (与单用例驱动一致, 调用exit也算正常结束, 覆盖情况照常匹配路径)
+ * 字符串数据的解析方式与单用例驱动中的atoi、atou、parse_string_to_array保持一致
+ */
+class BatchCodec {
+public:
+    using Parameters = std::vector<std::pair<std::string, std::string>>;
+
+    static void encodeTestCase(const Parameters& parameters, const std::vector<std::string>& args, std::string& stream){
+        std::string payload;
+        for(size_t i = 0; i < parameters.size(); ++i){
+            const auto& type = parameters[i].first;
+            const std::string data = i < args.size() ? args[i] : std::string();
+            if(type == "int"){
+                appendRaw(payload, static_cast<int32_t>(std::strtol(data.c_str(), nullptr, 10)));
+            }else if(type == "uint32_t"){
+                appendRaw(payload, parseUnsigned(data));
+            }else if(type == "int*"){
+                auto array = parseArray(data);
+                appendRaw(payload, static_cast<uint32_t>(array.size()));
+                payload.append(reinterpret_cast<const char*>(array.data()), array.size() * sizeof(int32_t));
+            }else if(type == "char*"){
+                appendRaw(payload, static_cast<uint32_t>(data.size()));
+                payload += data;
+            }else if(type == "char"){
+                payload += data.empty() ? '\0' : data[0];
+            }
+        }
+        appendRaw(stream, static_cast<uint32_t>(payload.size()));
+        stream += payload;
+    }
+
+    // 解析批量驱动的输出, 每条记录还原为与单用例驱动相同的'0'/'1'字符串; 返回成功解析的记录数
+    static size_t decodeRecords(const std::string& output, std::vector<std::string>& masks, std::vector<int>& status){
+        masks.clear();
+        status.clear();
+        uint32_t blockCount = 0;
+        if(output.size() < sizeof(blockCount)){
+            return 0;
+        }
+        std::memcpy(&blockCount, output.data(), sizeof(blockCount));
+        size_t recordSize = 1 + (blockCount + 7) / 8;
+        for(size_t pos = sizeof(blockCount); pos + recordSize <= output.size(); pos += recordSize){
+            std::string mask(blockCount, '0');
+            for(uint32_t i = 0; i < blockCount; ++i){
+                auto byte = static_cast<unsigned char>(output[pos + 1 + i / 8]);
+                if(byte & (1u << (i % 8))){
+                    mask[i] = '1';
+                }
+            }
+            status.push_back(static_cast<unsigned char>(output[pos]));
+            masks.push_back(std::move(mask));
+        }
+        return masks.size();
+    }
+
+    static uint32_t parseUnsigned(const std::string& str){
+        uint32_t number = 0;
+        for(char c : str){
+            if(c < '0' || c > '9'){
+                break;
+            }
+            if(number > UINT32_MAX / 10 || (number == UINT32_MAX / 10 && c - '0' > 5)){
+                return UINT32_MAX;
+            }
+            number = number * 10 + (c - '0');
+        }
+        return number;
+    }
+
+    static std::vector<int32_t> parseArray(const std::string& str){
+        std::vector<int32_t> array;
+        if(str.size() < 2 || (str[0] == '[' && str[1] == ']')){
+            return array;
+        }
+        int32_t number = 0;
+        bool isNegative = false, stop = false;
+        for(size_t i = 0; i <= str.size(); ++i){
+            char c = i < str.size() ? str[i] : '\0';
+            if(c >= '0' && c <= '9' && !stop){
+                if(isNegative){
+                    if(number < INT_MIN / 10 || (number == INT_MIN / 10 && c - '0' > 8)){
+                        number = INT_MIN;
+                        stop = true;
+                    }else{
+                        number = number * 10 - (c - '0');
+                    }
+                }else{
+                    if(number > INT_MAX / 10 || (number == INT_MAX / 10 && c - '0' > 7)){
+                        number = INT_MAX;
+                        stop = true;
+                    }else{
+                        number = number * 10 + (c - '0');
+                    }
+                }
+            }else if(c == '-'){
+                isNegative = true;
+            }else if(c == ',' || c == ']'){
+                array.push_back(number);
+                number = 0;
+                isNegative = false;
+                stop = false;
+            }
+        }
+        return array;
+    }
+
+private:
+    template<typename T>
+    static void appendRaw(std::string& buf, T value){
+        buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
 };
 
 class DriverGenerator {
@@ -33,10 +156,42 @@ public:
             return generateExecutableDriver(std::move(functionName));
         } else if(driverType == DRIVER_TYPE::DRIVER_KLEE_SE){
             return generateKleeDriver(std::move(functionName));
+        } else if(driverType == DRIVER_TYPE::DRIVER_BATCH){
+            return generateBatchDriver(std::move(functionName));
         }
         return {};
     }
 
+    // 驱动文件按函数区分, 同一个源文件中的多个函数可以同时生成和执行各自的驱动
+    static std::string getDriverFile(const std::string& srcFile, const std::string& functionName, DRIVER_TYPE driverType){
+        std::string suffix = "_driver.c";
+        if(driverType == DRIVER_TYPE::DRIVER_BATCH){
+            suffix = "_batch_driver.c";
+        }else if(driverType == DRIVER_TYPE::DRIVER_KLEE_SE){
+            suffix = "_klee_driver.c";
+        }
+        return getDirPath(srcFile) + getBaseName(srcFile) + "_" + functionName + suffix;
+    }
+
+    // 能否为函数生成驱动: 能找到函数的定义, 且所有参数的类型都受支持
+    bool isSupported(const std::string& functionName){
+        auto functionDeclaration = getFunctionDeclaration(srcFileName, functionName);
+        if(functionDeclaration.empty()){
+            return false;
+        }
+        for(const auto& [type, name] : getFunctionParameters(functionDeclaration, functionName)){
+            if (type != "int" && type != "uint32_t" && type != "int*" &&
+                type != "char*" && type != "char") {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<std::pair<std::string, std::string>> getParameters(const std::string& functionName){
+        return getFunctionParameters(getFunctionDeclaration(srcFileName, functionName), functionName);
+    }
+
     std::string getFunctionDeclaration(const std::string& srcFileName, const std::string& functionName){
         std::ifstream input(srcFileName);
         if(!input.is_open()){
@@ -101,17 +256,15 @@ public:
         return std::move(parameters);
     }
     
+    // 源文件已经修改过时不再写入; 需要修改时整体替换文件,
+    // 同时编译或读取这个源文件的其它线程只会看到修改前或修改后的完整内容
     bool modifyMainFunction(const std::string& fileName) {
         std::vector<std::string> lines;
         if(!readLinesFromFile(fileName, lines, false)){
             std::cout << "Cannot read file: " << fileName << std::endl;
             return false;
         }
-        std::ofstream outputFile(fileName);
-        if(!outputFile.is_open()){
-            std::cout << "Cannot open file: " << fileName << std::endl;
-            return false;
-        }
+        bool modified = false;
         for(auto& line : lines){
             if(line.find("main") != std::string::npos && line.find('(') != std::string::npos){
                 // 给line中的"main"两侧加上"__"
@@ -119,11 +272,21 @@ public:
                 if(pos != std::string::npos && (pos - 1 > 0 && line[pos - 1] != '_')) {
                     line.insert(pos, "__");
                     line.insert(pos + 6, "__");
+                    modified = true;
                 }
             }
-            outputFile << line << std::endl;
         }
-        outputFile.close();
+        if(!modified){
+            return true;
+        }
+        std::string content;
+        for(const auto& line : lines){
+            content += line + "\n";
+        }
+        if(!writeFileIfChanged(fileName, content)){
+            std::cout << "Cannot replace file: " << fileName << std::endl;
+            return false;
+        }
         return true;
     }
     
@@ -144,14 +307,11 @@ public:
             }
         }
         // 生成driver文件
-        std::string driverFileName = getDirPath(srcFileName) + getBaseName(srcFileName) + "_driver.c";
-        std::ofstream outputFile(driverFileName);
-        if (!outputFile.is_open()) {
-            std::cerr << "Cannot open driver file: " << driverFileName << std::endl;
-            return {};
-        }
+        std::string driverFileName = getDriverFile(srcFileName, functionName, DRIVER_TYPE::DRIVER_EXECUTABLE);
+        std::ostringstream outputFile;
         outputFile << "#include \"" << getBaseName(srcFileName) << ".c\"\n" << std::endl;
         outputFile << TEMPLATE_PARSER_STRING << "\n";
+        outputFile << TEMPLATE_MARKER_STRING << "\n";
         outputFile << TEMPLATE_MAIN_STRING;
         int idx = 1;
         for (const auto &[type, name]: parameters) {
@@ -190,11 +350,15 @@ public:
             outputFile << TEMPLATE_BLANK_STRING << "free(retVal);\n";
         }
         outputFile << TEMPLATE_END_STRING;
-        outputFile.close();
+        // 内容没有变化时不改写, 驱动的编译结果可以继续使用
+        if(!writeFileIfChanged(driverFileName, outputFile.str())){
+            std::cerr << "Cannot write driver file: " << driverFileName << std::endl;
+            return {};
+        }
         return driverFileName;
     }
 
-    std::string generateKleeDriver(std::string functionName) {
+    std::string generateBatchDriver(std::string functionName){
         auto functionDeclaration = getFunctionDeclaration(srcFileName, functionName);
         if(functionDeclaration.empty()){
             std::cerr << "Cannot find function declaration for " << functionName << std::endl;
@@ -211,12 +375,72 @@ public:
             }
         }
         // 生成driver文件
-        std::string driverFileName = getDirPath(srcFileName) + getBaseName(srcFileName) + "_klee_driver.c";
-        std::ofstream outputFile(driverFileName);
-        if (!outputFile.is_open()) {
-            std::cerr << "Cannot open driver file: " << driverFileName << std::endl;
+        std::string driverFileName = getDriverFile(srcFileName, functionName, DRIVER_TYPE::DRIVER_BATCH);
+        std::ostringstream outputFile;
+        outputFile << "#include \"" << getBaseName(srcFileName) << ".c\"\n" << std::endl;
+        outputFile << TEMPLATE_BATCH_STRING << "\n";
+        outputFile << TEMPLATE_BATCH_MAIN_STRING;
+        std::string indent = std::string(TEMPLATE_BLANK_STRING) + TEMPLATE_BLANK_STRING;
+        for (const auto &[type, name]: parameters) {
+            if (type == "int*") {
+                outputFile << indent << "int* " << name << " = batch_read_array();\n";
+            } else if (type == "char*") {
+                outputFile << indent << "char* " << name << " = batch_read_string();\n";
+            } else {
+                outputFile << indent << type << " " << name << " = 0;\n";
+                outputFile << indent << "batch_read(&" << name << ", sizeof(" << name << "));\n";
+            }
+        }
+        // 调用函数
+        outputFile << indent << "batch_reset_marker();\n";
+        outputFile << indent << "batch_in_case = 1;\n";
+        outputFile << indent << "batch_set_cpu_timer(batch_cpu_limit);\n";
+        outputFile << indent << returnType << "retVal = " << functionName << "(";
+        for(int i = 0; i < parameters.size(); ++i){
+            outputFile << parameters[i].second;
+            if(i != parameters.size() - 1){
+                outputFile << ", ";
+            }
+        }
+        outputFile << ");\n";
+        // 如果参数中有指针类型，需要释放内存
+        for(const auto& [type, name] : parameters){
+            if(type.find('*') != std::string::npos){
+                outputFile << indent << "free(" << name << ");\n";
+            }
+        }
+        // 如果返回值是指针类型，需要释放内存
+        if(returnType.find('*') != std::string::npos){
+            outputFile << indent << "free(retVal);\n";
+        }
+        outputFile << TEMPLATE_BATCH_END_STRING;
+        // 内容没有变化时不改写, 驱动的编译结果可以继续使用
+        if(!writeFileIfChanged(driverFileName, outputFile.str())){
+            std::cerr << "Cannot write driver file: " << driverFileName << std::endl;
             return {};
         }
+        return driverFileName;
+    }
+
+    std::string generateKleeDriver(std::string functionName) {
+        auto functionDeclaration = getFunctionDeclaration(srcFileName, functionName);
+        if(functionDeclaration.empty()){
+            std::cerr << "Cannot find function declaration for " << functionName << std::endl;
+            return {};
+        }
+        auto returnType = functionDeclaration.substr(0, functionDeclaration.find(functionName));
+        auto parameters = getFunctionParameters(functionDeclaration, functionName);
+        // 检查参数类型
+        for(const auto& [type, name] : parameters){
+            if (type != "int" && type != "uint32_t" && type != "int*" &&
+                type != "char*" && type != "char") {
+                std::cerr << "Unsupported parameter type: " << type << " " << name << std::endl;
+                return {};
+            }
+        }
+        // 生成driver文件
+        std::string driverFileName = getDriverFile(srcFileName, functionName, DRIVER_TYPE::DRIVER_KLEE_SE);
+        std::ostringstream outputFile;
         outputFile << KLEE_INCLUDE_STRING;
         outputFile << "#include \"" << getBaseName(srcFileName) << ".c\"\n" << std::endl;
         outputFile << KLEE_MAIN_STRING;
@@ -255,7 +479,11 @@ public:
             outputFile << TEMPLATE_BLANK_STRING << "free(retVal);\n";
         }
         outputFile << KLEE_END_STRING;
-        outputFile.close();
+        // 内容没有变化时不改写, 驱动的编译结果可以继续使用
+        if(!writeFileIfChanged(driverFileName, outputFile.str())){
+            std::cerr << "Cannot write driver file: " << driverFileName << std::endl;
+            return {};
+        }
         return driverFileName;
     }
 };
@@ -0,0 +1,269 @@
+#ifndef PCTRT_FUZZER_H
+#define PCTRT_FUZZER_H
+
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_set>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Constants.h>
+
+#include "generate/drivergenerator.h"
+#include "dynamic/testengine.h"
+#include "dynamic/execcache.h"
+#include "static/testcase.h"
+#include "utils/config.h"
+
+namespace PCTRT
+{
+
+/**
+ * Fuzzer: 以覆盖率为导向的变异测试
+ * 以复用得到的测试用例为初始语料, 每轮从语料中挑出执行路径与待覆盖路径的掩码最接近(汉明距离最小)的若干个,
+ * 按参数类型变异它们的输入, 在新版本的插桩驱动上成批执行。
+ * 覆盖了待覆盖路径的变异体被保留, 同时加入语料继续变异; 其余的变异体直接丢弃。
+ * 变异时除随机值外还使用被测函数中比较和switch出现的常量, 使等值判断也能较快满足。
+ */
+class Fuzzer {
+public:
+    using Parameters = std::vector<std::pair<std::string, std::string>>;
+
+private:
+    struct Seed {
+        TestCase tc;
+        std::string mask;       // 执行得到的基本块覆盖情况
+    };
+
+    TestEngine& tester;
+    Parameters parameters;
+    std::vector<Seed> corpus;
+    std::vector<int64_t> dictionary;            // 被测函数中出现的常量
+    std::unordered_set<std::string> tried;      // 已经执行过的输入的哈希
+    std::mt19937 rng {FUZZ_RANDOM_SEED};
+    std::chrono::steady_clock::time_point deadline {std::chrono::steady_clock::time_point::max()};
+
+public:
+    Fuzzer(TestEngine& engine, Parameters params)
+        : tester(engine)
+        , parameters(std::move(params))
+        {}
+
+    void setDeadline(std::chrono::steady_clock::time_point time){
+        this->deadline = time;
+    }
+
+    void addSeed(const TestCase& tc){
+        if(tc.isAbnormal() || tc.result.empty() || tc.inputs.size() != parameters.size()){
+            return;
+        }
+        if(tried.insert(ExecutionCache::hashInputs(tc)).second){
+            corpus.push_back({tc, tc.result});
+        }
+    }
+
+    // 收集函数中与变量比较的整数常量, 以及它们相邻的值
+    void addDictionary(const llvm::Function* function){
+        std::unordered_set<int64_t> values(dictionary.begin(), dictionary.end());
+        auto add = [&](const llvm::Value* value){
+            if(auto* constant = llvm::dyn_cast<llvm::ConstantInt>(value); constant != nullptr && constant->getBitWidth() <= 64){
+                int64_t c = constant->getSExtValue();
+                for(int64_t v : {c - 1, c, c + 1}){
+                    if(values.insert(v).second){
+                        dictionary.push_back(v);
+                    }
+                }
+            }
+        };
+        for(const auto& bb : *function){
+            for(const auto& inst : bb){
+                if(auto* cmp = llvm::dyn_cast<llvm::ICmpInst>(&inst)){
+                    add(cmp->getOperand(0));
+                    add(cmp->getOperand(1));
+                }else if(auto* sw = llvm::dyn_cast<llvm::SwitchInst>(&inst)){
+                    for(const auto& caseIt : sw->cases()){
+                        add(caseIt.getCaseValue());
+                    }
+                }
+            }
+        }
+    }
+
+    // 运行最多rounds轮变异(超过deadline后不再开始新的一轮), 覆盖了pending中路径的变异体加入kept, 被覆盖的路径从pending中移除
+    void run(size_t rounds, std::unordered_set<int>& pending, TestSuite& kept){
+        auto& cfg = tester.getCFG();
+        if(parameters.empty()){
+            return;
+        }
+        for(size_t round = 0; round < rounds && !pending.empty() && !corpus.empty()
+                              && std::chrono::steady_clock::now() < deadline; ++round){
+            std::vector<std::string> targets;
+            for(int pathId : pending){
+                if(pathId >= 0 && pathId < cfg.getPaths().size()){
+                    targets.push_back(cfg.getPaths()[pathId].to_string());
+                }
+            }
+            TestSuite batch;
+            auto seeds = pickSeeds(targets);
+            for(size_t i = 0; i < FUZZ_BATCH_SIZE; ++i){
+                TestCase mutant = mutate(corpus[seeds[i % seeds.size()]].tc);
+                if(tried.insert(ExecutionCache::hashInputs(mutant)).second){
+                    batch.addTestCase(std::move(mutant));
+                }
+            }
+            if(batch.testCases.empty()){
+                continue;
+            }
+            std::vector<std::string> outputs;
+            tester.execute(batch, outputs);
+            for(size_t i = 0; i < outputs.size(); ++i){
+                auto& tc = batch.testCases[i];
+                if(tc.isAbnormal()){
+                    continue;
+                }
+                TestEngine::removeBlanks(outputs[i]);
+                std::vector<int> covered;
+                for(int pathId : cfg.matchPathIds(outputs[i])){
+                    if(pending.erase(pathId) > 0){
+                        covered.push_back(pathId);
+                    }
+                }
+                if(covered.empty()){
+                    continue;
+                }
+                tc.description = "test case generated by fuzzer for path " + std::to_string(covered.front());
+                kept.addTestCase(tc);
+                corpus.push_back({std::move(tc), std::move(outputs[i])});
+            }
+        }
+    }
+
+private:
+    static size_t hamming(const std::string& a, const std::string& b){
+        size_t distance = a.size() > b.size() ? a.size() - b.size() : b.size() - a.size();
+        for(size_t i = 0; i < std::min(a.size(), b.size()); ++i){
+            distance += a[i] != b[i];
+        }
+        return distance;
+    }
+
+    // 按到最近的待覆盖路径的距离排序, 取最近的FUZZ_SEEDS_PER_ROUND个语料
+    std::vector<size_t> pickSeeds(const std::vector<std::string>& targets) const {
+        std::vector<std::pair<size_t, size_t>> ranked;      // (距离, 语料下标)
+        for(size_t i = 0; i < corpus.size(); ++i){
+            size_t distance = SIZE_MAX;
+            for(const auto& target : targets){
+                distance = std::min(distance, hamming(corpus[i].mask, target));
+            }
+            ranked.emplace_back(distance, i);
+        }
+        size_t count = std::min<size_t>(ranked.size(), FUZZ_SEEDS_PER_ROUND);
+        std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end());
+        std::vector<size_t> seeds;
+        for(size_t k = 0; k < count; ++k){
+            seeds.push_back(ranked[k].second);
+        }
+        return seeds;
+    }
+
+    size_t below(size_t n){
+        return std::uniform_int_distribution<size_t>(0, n - 1)(rng);
+    }
+
+    // 变异一个或多个参数
+    TestCase mutate(const TestCase& seed){
+        TestCase mutant = seed;
+        mutant.result.clear();
+        mutant.status.clear();
+        mutant.pathId = INVALID_PATH_ID;
+        size_t times = 1 + below(2);
+        for(size_t t = 0; t < times; ++t){
+            size_t i = below(parameters.size());
+            auto& data = mutant.inputs[i].data;
+            const auto& type = parameters[i].first;
+            if(type == "int"){
+                data = std::to_string(mutateInteger(std::strtol(data.c_str(), nullptr, 10), INT32_MIN, INT32_MAX));
+            }else if(type == "uint32_t"){
+                data = std::to_string(mutateInteger(BatchCodec::parseUnsigned(data), 0, UINT32_MAX));
+            }else if(type == "char"){
+                int64_t c = data.empty() ? 0 : data[0];
+                c = mutateInteger(c, 0, CHAR_MAX);
+                data = c == 0 ? std::string() : std::string(1, static_cast<char>(c));
+            }else if(type == "int*"){
+                data = mutateArray(data);
+            }else{
+                data = mutateString(data);
+            }
+        }
+        return mutant;
+    }
+
+    int64_t mutateInteger(int64_t value, int64_t lo, int64_t hi){
+        switch(below(5)){
+            case 0: {
+                if(!dictionary.empty()){
+                    value = dictionary[below(dictionary.size())];
+                    break;
+                }
+                [[fallthrough]];
+            }
+            case 1: value += static_cast<int64_t>(below(2 * FUZZ_MAX_DELTA + 1)) - FUZZ_MAX_DELTA; break;
+            case 2: value ^= int64_t(1) << below(32); break;
+            case 3: {
+                const int64_t interesting[] = {0, 1, -1, 16, 32, 64, 100, 127, 128, 255, 256, 1024, 65535, INT32_MAX, INT32_MIN};
+                value = interesting[below(std::size(interesting))];
+                break;
+            }
+            default: value = std::uniform_int_distribution<int64_t>(lo, hi)(rng); break;
+        }
+        return std::clamp(value, lo, hi);
+    }
+
+    std::string mutateArray(const std::string& data){
+        auto array = BatchCodec::parseArray(data);
+        size_t choice = below(4);
+        if(array.empty() || (choice == 0 && array.size() < KLEE_ARRAY_SIZE)){
+            array.insert(array.begin() + static_cast<long>(below(array.size() + 1)), 0);
+        }else if(choice == 1 && array.size() > 1){
+            array.erase(array.begin() + static_cast<long>(below(array.size())));
+        }else{
+            auto& element = array[below(array.size())];
+            element = static_cast<int32_t>(mutateInteger(element, INT32_MIN, INT32_MAX));
+        }
+        std::string result = "[";
+        for(size_t i = 0; i < array.size(); ++i){
+            result += (i == 0 ? "" : ", ") + std::to_string(array[i]);
+        }
+        return result + "]";
+    }
+
+    // 字符串只使用可打印字符, 逐个测试用例执行时它们作为命令行参数传递
+    std::string mutateString(std::string data){
+        auto randomChar = [&](){
+            if(!dictionary.empty() && below(2) == 0){
+                int64_t c = dictionary[below(dictionary.size())];
+                if(c >= ' ' && c <= '~'){
+                    return static_cast<char>(c);
+                }
+            }
+            return static_cast<char>(' ' + below('~' - ' ' + 1));
+        };
+        size_t choice = below(3);
+        if(data.empty() || (choice == 0 && data.size() < FUZZ_MAX_STRING)){
+            data.insert(data.begin() + static_cast<long>(below(data.size() + 1)), randomChar());
+        }else if(choice == 1){
+            data.erase(below(data.size()), 1);
+        }else{
+            data[below(data.size())] = randomChar();
+        }
+        return data;
+    }
+};
+
+} // namespace PCTRT
+
+#endif //PCTRT_FUZZER_H
@@ -0,0 +1,252 @@
+#ifndef PCTRT_KTEST_H
+#define PCTRT_KTEST_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "static/testcase.h"
+#include "generate/drivergenerator.h"
+#include "utils/common.h"
+
+namespace PCTRT
+{
+
+#define KTEST_VERSION 3
+
+/**
+ * KTest: KLEE生成的.ktest文件
+ * 文件格式(整数均为大端序): "KTEST" | version | 参数个数 | 参数(长度 + 内容)... |
+ * (version >= 2时) 符号参数个数 | 符号参数长度 | 对象个数 | 对象(名称长度 + 名称 + 数据长度 + 数据)...
+ * 对象的数据是被测程序中符号变量的内存内容, 按本机字节序(小端)解释。
+ */
+class KTest {
+public:
+    using Parameters = std::vector<std::pair<std::string, std::string>>;
+
+    struct Object {
+        std::string name;
+        std::string bytes;
+    };
+
+    std::string path;
+    std::vector<std::string> args;
+    std::vector<Object> objects;
+
+    static bool fromFile(const std::string& file, KTest& ktest){
+        std::ifstream fin(file, std::ios::binary);
+        if(!fin){
+            std::cout << "Cannot open ktest file: " << file << std::endl;
+            return false;
+        }
+        std::string content((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+        ktest.path = file;
+        if(!ktest.parse(content)){
+            std::cout << "Unrecognized ktest file: " << file << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // 用于去重的哈希, 只与对象的数据有关
+    [[nodiscard]] uint64_t dataHash() const {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for(const auto& object : objects){
+            for(char c : object.name + '\0' + object.bytes){
+                hash ^= static_cast<unsigned char>(c);
+                hash *= 0x100000001b3ULL;
+            }
+        }
+        return hash;
+    }
+
+    [[nodiscard]] const Object* findObject(const std::string& name) const {
+        for(const auto& object : objects){
+            if(object.name == name){
+                return &object;
+            }
+        }
+        return nullptr;
+    }
+
+    // 按驱动函数的参数列表把对象转换为测试用例的输入, 数据格式与可执行驱动的解析方式一致;
+    // 缺少某个参数对应的对象时返回false
+    bool toTestCase(const Parameters& parameters, TestCase& tc) const {
+        tc.inputs.clear();
+        for(const auto& [type, name] : parameters){
+            const Object* object = findObject(name);
+            if(object == nullptr){
+                std::cout << "Cannot find object " << name << " in ktest file " << path << std::endl;
+                return false;
+            }
+            tc.inputs.push_back({name, type, decodeValue(type, object->bytes)});
+        }
+        return true;
+    }
+
+    // 把测试用例的输入编码为KLEE驱动中符号变量的内存内容, 用作-seed-file。
+    // 对象的名称和顺序与klee驱动中klee_make_symbolic的调用一致, 数组和字符串按KLEE_ARRAY_SIZE截断或补齐
+    static KTest fromTestCase(const Parameters& parameters, const TestCase& tc){
+        KTest ktest;
+        for(size_t i = 0; i < parameters.size(); ++i){
+            const auto& [type, name] = parameters[i];
+            const std::string data = i < tc.inputs.size() ? tc.inputs[i].data : std::string();
+            ktest.objects.push_back({name, encodeValue(type, data)});
+        }
+        return ktest;
+    }
+
+    bool toFile(const std::string& file) const {
+        std::string content = "KTEST";
+        writeBig(content, KTEST_VERSION);
+        writeBig(content, static_cast<uint32_t>(args.size()));
+        for(const auto& arg : args){
+            writeBytes(content, arg);
+        }
+        writeBig(content, 0);   // 符号参数个数
+        writeBig(content, 0);   // 符号参数长度
+        writeBig(content, static_cast<uint32_t>(objects.size()));
+        for(const auto& object : objects){
+            writeBytes(content, object.name);
+            writeBytes(content, object.bytes);
+        }
+        std::ofstream fout(file, std::ios::binary);
+        if(!fout){
+            std::cout << "Cannot write ktest file: " << file << std::endl;
+            return false;
+        }
+        fout.write(content.data(), static_cast<std::streamsize>(content.size()));
+        return true;
+    }
+
+    static std::string encodeValue(const std::string& type, const std::string& data){
+        std::string bytes;
+        if(type == "int"){
+            auto value = static_cast<int32_t>(std::strtol(data.c_str(), nullptr, 10));
+            bytes.assign(reinterpret_cast<const char*>(&value), sizeof(value));
+        }else if(type == "uint32_t"){
+            uint32_t value = BatchCodec::parseUnsigned(data);
+            bytes.assign(reinterpret_cast<const char*>(&value), sizeof(value));
+        }else if(type == "int*"){
+            auto array = BatchCodec::parseArray(data);
+            array.resize(KLEE_ARRAY_SIZE, 0);
+            bytes.assign(reinterpret_cast<const char*>(array.data()), array.size() * sizeof(int32_t));
+        }else if(type == "char"){
+            bytes.assign(1, data.empty() ? '\0' : data[0]);
+        }else{
+            bytes = data.substr(0, KLEE_ARRAY_SIZE);
+            bytes.resize(KLEE_ARRAY_SIZE, '\0');
+        }
+        return bytes;
+    }
+
+    static std::string decodeValue(const std::string& type, const std::string& bytes){
+        if(type == "int"){
+            return std::to_string(readLittle<int32_t>(bytes, 0));
+        }
+        if(type == "uint32_t"){
+            return std::to_string(readLittle<uint32_t>(bytes, 0));
+        }
+        if(type == "int*"){
+            std::string data = "[";
+            for(size_t offset = 0; offset + sizeof(int32_t) <= bytes.size(); offset += sizeof(int32_t)){
+                if(offset > 0){
+                    data += ", ";
+                }
+                data += std::to_string(readLittle<int32_t>(bytes, offset));
+            }
+            return data + "]";
+        }
+        if(type == "char"){
+            // '\0'对应空字符串, 驱动中argv[i][0]同样得到'\0'
+            return bytes.empty() || bytes[0] == '\0' ? std::string() : std::string(1, bytes[0]);
+        }
+        // char*及其它类型: 按C字符串截断到第一个'\0'
+        return bytes.substr(0, bytes.find('\0'));
+    }
+
+private:
+    template<typename T>
+    static T readLittle(const std::string& bytes, size_t offset){
+        T value = 0;
+        if(offset + sizeof(T) <= bytes.size()){
+            memcpy(&value, bytes.data() + offset, sizeof(T));
+        }
+        return value;
+    }
+
+    static bool readBig(const std::string& content, size_t& pos, uint32_t& value){
+        if(pos + 4 > content.size()){
+            return false;
+        }
+        const auto* p = reinterpret_cast<const unsigned char*>(content.data() + pos);
+        value = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+        pos += 4;
+        return true;
+    }
+
+    static void writeBig(std::string& content, uint32_t value){
+        content.push_back(static_cast<char>(value >> 24));
+        content.push_back(static_cast<char>(value >> 16));
+        content.push_back(static_cast<char>(value >> 8));
+        content.push_back(static_cast<char>(value));
+    }
+
+    static void writeBytes(std::string& content, const std::string& bytes){
+        writeBig(content, static_cast<uint32_t>(bytes.size()));
+        content += bytes;
+    }
+
+    static bool readBytes(const std::string& content, size_t& pos, std::string& bytes){
+        uint32_t size;
+        if(!readBig(content, pos, size) || pos + size > content.size()){
+            return false;
+        }
+        bytes.assign(content, pos, size);
+        pos += size;
+        return true;
+    }
+
+    // 剩余的内容至少还能放下count个每个至少minSize字节的记录, 避免损坏的文件中的数量导致过大的分配
+    static bool holds(const std::string& content, size_t pos, uint32_t count, size_t minSize){
+        return pos <= content.size() && uint64_t(count) * minSize <= content.size() - pos;
+    }
+
+    bool parse(const std::string& content){
+        if(content.compare(0, 5, "KTEST") != 0 && content.compare(0, 5, "BOUT\n") != 0){
+            return false;
+        }
+        size_t pos = 5;
+        uint32_t version, numArgs, numObjects, unused;
+        if(!readBig(content, pos, version) || version > KTEST_VERSION || !readBig(content, pos, numArgs)
+           || !holds(content, pos, numArgs, 4)){
+            return false;
+        }
+        args.resize(numArgs);
+        for(auto& arg : args){
+            if(!readBytes(content, pos, arg)){
+                return false;
+            }
+        }
+        if(version >= 2 && !(readBig(content, pos, unused) && readBig(content, pos, unused))){
+            return false;
+        }
+        if(!readBig(content, pos, numObjects) || !holds(content, pos, numObjects, 8)){
+            return false;
+        }
+        objects.resize(numObjects);
+        for(auto& object : objects){
+            if(!readBytes(content, pos, object.name) || !readBytes(content, pos, object.bytes)){
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace PCTRT
+
+#endif //PCTRT_KTEST_H
@@ -4,76 +4,132 @@
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/IRBuilder.h>
+#include <map>
+#include <memory>
 #include "static/cfg.h"
 #include "utils/common.h"
 
 namespace PCTRT
 {
 
-class RollingHashIndex {
+/**
+ * UniqueSubSeqIndex: 每条路径中只出现一次的最短子序列(长度至少为2)
+ * 对所有路径建立广义后缀自动机, 每个状态的出现次数为它的endpos集合在所有路径中的大小。
+ * 路径p的每个前缀所在的状态沿后缀链接向上, 出现次数单调不减, 最高的出现次数为1的祖先给出了
+ * 在该位置结束的最短唯一子序列的长度。构建和查询整体为线性时间, 结果在构造时一次算出。
+ * 长度相同时取起点最靠前的子序列, 与逐个长度枚举的结果一致。
+ */
+class UniqueSubSeqIndex {
 private:
-    size_t A;
-    const size_t M = 1e9+7;
-    std::unordered_map<size_t, std::vector<int>> index;
-    std::vector<std::vector<int>> sequences;
-    int hash_len {1};
-
-    size_t hash(size_t hashA, size_t hashB) const {
-        auto h1 = hashA + 1LL;
-        auto h2 = hashB + 1LL;
-        return (h1 * A + h2) % M;
-    }
+    struct State {
+        int len {0};
+        int link {-1};
+        std::map<int, int> next;
+        size_t count {0};       // 在所有路径中的出现次数
+        int topUnique {-1};     // 后缀链接路径上最高的出现次数为1的状态
+    };
 
-    void updateIndex(int len) {
-        if(hash_len >= len) {
-            return;
-        }
-        hash_len++;
-        for(int idx = 0; idx < sequences.size(); ++idx){
-            const auto& seq = sequences[idx];
-            int n = static_cast<int>(seq.size());
-            if(n < hash_len){
-                continue;
-            }
-            for(int i = 0; i <= n - hash_len; ++i){
-                size_t h = 0;
-                for(int j = i; j < i + hash_len; ++j){
-                    h = hash(h, seq[j]) % M;
-                }
-                index[h].push_back(idx);
+    std::vector<State> states;
+    std::vector<std::vector<int>> answers;
+
+    int extend(int last, int c){
+        if(states[last].next.count(c) > 0){
+            int q = states[last].next[c];
+            if(states[q].len == states[last].len + 1){
+                return q;
             }
+            return split(last, q, c);
+        }
+        int cur = static_cast<int>(states.size());
+        states.push_back({states[last].len + 1, -1, {}, 0, -1});
+        int p = last;
+        while(p != -1 && states[p].next.count(c) == 0){
+            states[p].next[c] = cur;
+            p = states[p].link;
+        }
+        if(p == -1){
+            states[cur].link = 0;
+        }else{
+            int q = states[p].next[c];
+            int link = states[q].len == states[p].len + 1 ? q : split(p, q, c);
+            states[cur].link = link;
         }
+        return cur;
     }
 
-public:
-    explicit RollingHashIndex(const std::vector<std::vector<int>>& seqs, size_t max_item_size = 131)
-    : sequences(seqs), A(max_item_size) {
-        updateIndex(2);
+    // 把状态q中长度不超过len(p)+1的部分复制为新状态
+    int split(int p, int q, int c){
+        int clone = static_cast<int>(states.size());
+        states.push_back({states[p].len + 1, states[q].link, states[q].next, 0, -1});
+        while(p != -1 && states[p].next.count(c) > 0 && states[p].next[c] == q){
+            states[p].next[c] = clone;
+            p = states[p].link;
+        }
+        states[q].link = clone;
+        return clone;
     }
 
-    std::vector<int> getShortestUniqueSubSeq(int id) {
-        PCTRT_ASSERT(id >= 0 && id < sequences.size(), "Invalid sequence id");
-        const std::vector<int>& seq = sequences[id];
-        int n = static_cast<int>(seq.size());
-        for(int l = 2; l <= seq.size(); ++l) {
-            for(int i = 0; i <= n - l; ++i){
-                size_t h = 0;
-                for(int j = i; j < i + l; ++j){
-                    h = hash(h, seq[j]);
+public:
+    explicit UniqueSubSeqIndex(const std::vector<std::vector<int>>& seqs){
+        states.push_back({});
+        std::vector<std::vector<int>> prefixStates(seqs.size());
+        for(size_t idx = 0; idx < seqs.size(); ++idx){
+            int last = 0;
+            for(int c : seqs[idx]){
+                last = extend(last, c);
+                prefixStates[idx].push_back(last);
+            }
+        }
+        for(const auto& prefixes : prefixStates){
+            for(int state : prefixes){
+                states[state].count++;
+            }
+        }
+        // 按长度从大到小把出现次数累加到后缀链接上, 再按长度从小到大计算topUnique
+        std::vector<int> order(states.size());
+        for(size_t i = 0; i < order.size(); ++i){
+            order[i] = static_cast<int>(i);
+        }
+        std::sort(order.begin(), order.end(), [this](int a, int b){ return states[a].len < states[b].len; });
+        for(auto it = order.rbegin(); it != order.rend(); ++it){
+            if(states[*it].link >= 0){
+                states[states[*it].link].count += states[*it].count;
+            }
+        }
+        for(int state : order){
+            if(state == 0 || states[state].count != 1){
+                continue;
+            }
+            int link = states[state].link;
+            states[state].topUnique = link > 0 && states[link].count == 1 ? states[link].topUnique : state;
+        }
+        answers.resize(seqs.size());
+        for(size_t idx = 0; idx < seqs.size(); ++idx){
+            int bestLen = 0, bestStart = 0;
+            for(size_t j = 0; j < seqs[idx].size(); ++j){
+                int top = states[prefixStates[idx][j]].topUnique;
+                if(top < 0){
+                    continue;
                 }
-                if(index.count(h) == 0){
-                    std::cout << "Not found seq from " << i << " to " << i + l - 1 << " in path " << id << std::endl;
-                    return {};
+                int len = std::max(2, states[states[top].link].len + 1);
+                if(len > static_cast<int>(j) + 1){
+                    continue;
                 }
-                if(index[h].size() == 1 && index[h].front() == id){
-                    return {seq.begin() + i, seq.begin() + i + l};
+                if(bestLen == 0 || len < bestLen){
+                    bestLen = len;
+                    bestStart = static_cast<int>(j) + 1 - len;
                 }
             }
-            updateIndex(l + 1);
+            if(bestLen > 0){
+                answers[idx].assign(seqs[idx].begin() + bestStart, seqs[idx].begin() + bestStart + bestLen);
+            }
         }
-        return {};
     }
 
+    [[nodiscard]] const std::vector<int>& getShortestUniqueSubSeq(int id) const {
+        PCTRT_ASSERT(id >= 0 && id < answers.size(), "Invalid sequence id");
+        return answers[id];
+    }
 };
 
 class PathInstrument {
@@ -86,17 +142,17 @@ private:
     std::unordered_map<int, llvm::BasicBlock*> blockMap;
     std::vector<std::vector<int>> paths;
 
-    std::unordered_set<int> triggerBlocks;  // 需要插桩访问的基本块
-    std::unordered_set<int> exitBlocks; // 需要插桩退出搜索的基本块
-
-    std::unique_ptr<RollingHashIndex> rollingHashIndex {nullptr};
+    std::shared_ptr<const UniqueSubSeqIndex> uniqueIndex {nullptr};
     llvm::FunctionType *triggerFuncType {nullptr};
     llvm::FunctionType *exitFuncType {nullptr};
 
 public:
-    explicit PathInstrument(std::unique_ptr<llvm::Module> mod, std::string funcName)
+    // index为同一个函数之前构建的索引, 为空时重新构建
+    explicit PathInstrument(std::unique_ptr<llvm::Module> mod, std::string funcName,
+                            std::shared_ptr<const UniqueSubSeqIndex> index = nullptr)
     : module(std::move(mod))
     , functionName(std::move(funcName))
+    , uniqueIndex(std::move(index))
     {
         function = module->getFunction(functionName);
         PCTRT_ASSERT(function != nullptr, "Function not found");
@@ -130,19 +186,28 @@ public:
         for(auto& path : cfgPaths){
             paths.push_back(path.to_vector_of_nodes());
         }
-        rollingHashIndex = std::make_unique<RollingHashIndex>(paths, cfg->getSize());
+        if(uniqueIndex == nullptr){
+            uniqueIndex = std::make_shared<const UniqueSubSeqIndex>(paths);
+        }
+    }
+
+    [[nodiscard]] std::shared_ptr<const UniqueSubSeqIndex> getUniqueIndex() const {
+        return uniqueIndex;
     }
 
-    // 设置目标路径中需要插桩的基本块
-    bool setPathToInstrument (int pathId) {
+    // 设置目标路径中需要插桩的基本块。
+    // 一个模块中可以编码多条目标路径, targetId为目标路径在模块中的序号:
+    // trigger函数的参数为(targetId << 2) | 边的标记, exit函数的参数为targetId
+    bool setPathToInstrument (int pathId, int targetId = 0) {
         if(pathId < 0 || pathId >= cfg->getPaths().size()){
             return false;
         }
         auto seq = cfg->getPaths()[pathId].to_vector_of_nodes();
-        auto subSeq = rollingHashIndex->getShortestUniqueSubSeq(pathId);
+        const auto& subSeq = uniqueIndex->getShortestUniqueSubSeq(pathId);
         if(subSeq.empty()){
             return false;
         }
+        std::unordered_set<int> exitBlocks; // 需要插桩退出搜索的基本块
         // 将seq中有每个其他后继节点的基本块后继节点插入到exitBlocks中
         for(int i = 0; i < seq.size() - 1; ++i){
             auto successors = cfg->getBlockSuccessors(seq[i]);
@@ -157,12 +222,12 @@ public:
             int mask = 0;
             mask |= (static_cast<int>(i != 0) << 1);             // 边的到达点
             mask |= (static_cast<int>(i != subSeq.size() - 1));  // 边的起始点
-            insertTriggerFunctionCall(blockMap[subSeq[i]], mask);
+            insertTriggerFunctionCall(blockMap[subSeq[i]], (targetId << 2) | mask);
         }
         // 对exitBlocks中的每个基本块都插桩
         for(auto& bbId : exitBlocks){
             auto bb = blockMap[bbId];
-            insertExitFunctionCall(bb, 0);
+            insertExitFunctionCall(bb, targetId);
         }
         return true;
     }
@@ -190,12 +255,25 @@ public:
 
     // 为需要的目标路径生成插桩后的IR文件
     void generateInstrumentedIR(int pathId, const std::string& filePath){
-        if(setPathToInstrument(pathId)){
+        generateInstrumentedIR(std::vector<int>{pathId}, filePath);
+    }
+
+    // 把多条目标路径编码到同一个IR文件中, 一次KLEE运行同时搜索这些路径。
+    // 返回成功插桩的路径, 它们的targetId依次为0, 1, 2...
+    std::vector<int> generateInstrumentedIR(const std::vector<int>& pathIds, const std::string& filePath){
+        std::vector<int> targets;
+        for(int pathId : pathIds){
+            if(setPathToInstrument(pathId, static_cast<int>(targets.size()))){
+                targets.push_back(pathId);
+            }
+        }
+        if(!targets.empty()){
             std::error_code EC;
             llvm::raw_fd_ostream os(filePath, EC);
             module->print(os, nullptr);
             os.close();
         }
+        return targets;
     }
 
 };
@@ -0,0 +1,520 @@
+#ifndef PCTRT_PATHSOLVER_H
+#define PCTRT_PATHSOLVER_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <algorithm>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IntrinsicInst.h>
+
+#include "static/testcase.h"
+#include "utils/common.h"
+
+namespace PCTRT
+{
+
+/**
+ * PathSolver: 只处理简单分支条件的轻量级求解器
+ * 沿目标路径依次解释每条指令: 不逃逸的局部变量(只被直接load/store的alloca)的值按路径精确传播,
+ * 值为常量或"标量参数 + 常量偏移"时可以继续计算, 其它值一律视为未知。
+ * 条件分支的条件为常量时直接判断能否走目标边; 为参数的比较时转换为参数的取值区间(以及不能取的值),
+ * 最后在区间中为每个参数挑一个值。遇到条件未知的分支时这条路径求不出, 交给KLEE处理。
+ * 求解时所做的简化(例如对偏移量加上不溢出的限制)只会缩小取值范围, 得到的输入一定满足所有条件;
+ * 只有没有经过这些简化的约束发生矛盾时才判定路径不可行, 未知的条件被忽略, 不影响这一结论。
+ */
+class PathSolver {
+public:
+    using Parameters = std::vector<std::pair<std::string, std::string>>;
+
+    enum class Verdict {
+        SOLVED,         // 求出了一组输入
+        UNKNOWN,        // 求不出, 也不能证明不可行
+        INFEASIBLE      // 路径上的条件互相矛盾
+    };
+
+private:
+    enum class EdgeResult { OK, UNKNOWN, CONFLICT };
+
+    struct Domain {
+        int64_t lo {0};
+        int64_t hi {0};
+        std::set<int64_t> excluded;     // 区间中不能取的值
+        bool exact {true};              // 是否只经过精确的约束, 否则为空时不能说明路径不可行
+
+        void restrict(int64_t low, int64_t high){
+            lo = std::max(lo, low);
+            hi = std::min(hi, high);
+        }
+
+        [[nodiscard]] bool empty() const {
+            if(lo > hi){
+                return true;
+            }
+            auto first = excluded.lower_bound(lo), last = excluded.upper_bound(hi);
+            return static_cast<uint64_t>(std::distance(first, last)) > static_cast<uint64_t>(hi - lo);
+        }
+    };
+
+    // 路径上的一个值: 未知、常量或 参数 + offset
+    struct Symbol {
+        enum Kind { UNKNOWN, CONST, AFFINE } kind {UNKNOWN};
+        int64_t value {0};      // CONST时为值(按符号扩展), AFFINE时为偏移
+        int param {-1};
+        bool noWrap {true};     // AFFINE中的加减法是否都带有nsw标记
+
+        static Symbol constant(int64_t v){
+            return {CONST, v, -1, true};
+        }
+    };
+
+    // 沿路径解释时的状态
+    struct State {
+        std::unordered_map<const llvm::Value*, Symbol> values;      // 指令 -> 最近一次执行得到的值
+        std::unordered_map<const llvm::Value*, Symbol> memory;      // 不逃逸的alloca -> 当前保存的值
+        std::vector<Domain> domains;
+    };
+
+    llvm::Function* function;
+    Parameters parameters;
+    std::vector<llvm::BasicBlock*> blocks;      // 基本块id -> 基本块, 与CFG中的编号一致
+    std::unordered_set<const llvm::Value*> localSlots;      // 只被直接读写的整数alloca
+
+public:
+    PathSolver(llvm::Function* func, Parameters params)
+        : function(func)
+        , parameters(std::move(params))
+        {
+            for(auto& bb : *function){
+                blocks.push_back(&bb);
+            }
+            findLocalSlots();
+        }
+
+    // 为基本块序列表示的路径求一组输入, 求不出时返回false
+    bool solve(const std::vector<int>& blockSeq, TestCase& tc){
+        return check(blockSeq, tc) == Verdict::SOLVED;
+    }
+
+    Verdict check(const std::vector<int>& blockSeq, TestCase& tc){
+        State state;
+        state.domains.resize(parameters.size());
+        for(size_t i = 0; i < parameters.size(); ++i){
+            auto [lo, hi] = typeRange(parameters[i].first);
+            state.domains[i].lo = lo;
+            state.domains[i].hi = hi;
+        }
+        bool complete = true;
+        for(size_t i = 0; i < blockSeq.size(); ++i){
+            if(blockSeq[i] < 0 || blockSeq[i] >= blocks.size()){
+                return Verdict::UNKNOWN;
+            }
+            interpret(blocks[blockSeq[i]], i > 0 ? blocks[blockSeq[i - 1]] : nullptr, state);
+            if(i + 1 == blockSeq.size()){
+                break;
+            }
+            auto result = applyEdge(blocks[blockSeq[i]], blocks[blockSeq[i + 1]], state);
+            if(result == EdgeResult::CONFLICT){
+                return Verdict::INFEASIBLE;
+            }
+            complete = complete && result == EdgeResult::OK;
+            for(const auto& domain : state.domains){
+                if(domain.exact && domain.empty()){
+                    return Verdict::INFEASIBLE;
+                }
+            }
+        }
+        if(!complete){
+            return Verdict::UNKNOWN;
+        }
+        tc.inputs.clear();
+        for(size_t i = 0; i < parameters.size(); ++i){
+            int64_t value;
+            if(!pickValue(state.domains[i], value)){
+                return Verdict::UNKNOWN;
+            }
+            const auto& [type, name] = parameters[i];
+            tc.inputs.push_back({name, type, formatValue(type, value)});
+        }
+        return Verdict::SOLVED;
+    }
+
+private:
+    static bool isScalar(const std::string& type){
+        return type == "int" || type == "uint32_t" || type == "char";
+    }
+
+    static std::pair<int64_t, int64_t> typeRange(const std::string& type){
+        if(type == "uint32_t"){
+            return {0, UINT32_MAX};
+        }
+        if(type == "char"){
+            return {INT8_MIN, INT8_MAX};
+        }
+        return {INT32_MIN, INT32_MAX};
+    }
+
+    static unsigned typeBits(const std::string& type){
+        return type == "char" ? 8 : 32;
+    }
+
+    static std::string formatValue(const std::string& type, int64_t value){
+        if(type == "int*"){
+            std::string data = "[";
+            for(int i = 0; i < KLEE_ARRAY_SIZE; ++i){
+                data += i == 0 ? "0" : ", 0";
+            }
+            return data + "]";
+        }
+        if(type == "char*"){
+            return "";
+        }
+        if(type == "char"){
+            return value == 0 ? std::string() : std::string(1, static_cast<char>(value));
+        }
+        return std::to_string(value);
+    }
+
+    // 只被直接load/store(且不作为被保存的值)的整数alloca不会被路径以外的代码修改, 它的值可以沿路径传播
+    void findLocalSlots(){
+        for(auto& inst : function->getEntryBlock()){
+            auto* slot = llvm::dyn_cast<llvm::AllocaInst>(&inst);
+            if(slot == nullptr || slot->isArrayAllocation() || !slot->getAllocatedType()->isIntegerTy()){
+                continue;
+            }
+            bool local = true;
+            for(const auto* user : slot->users()){
+                if(auto* load = llvm::dyn_cast<llvm::LoadInst>(user)){
+                    local = local && !load->isVolatile() && load->getType() == slot->getAllocatedType();
+                }else if(auto* store = llvm::dyn_cast<llvm::StoreInst>(user)){
+                    local = local && !store->isVolatile() && store->getValueOperand() != slot
+                                  && store->getValueOperand()->getType() == slot->getAllocatedType();
+                }else{
+                    local = local && llvm::isa<llvm::DbgInfoIntrinsic>(user);
+                }
+            }
+            if(local){
+                localSlots.insert(slot);
+            }
+        }
+    }
+
+    Symbol symbolOf(const llvm::Value* value, const State& state) const {
+        if(auto* constant = llvm::dyn_cast<llvm::ConstantInt>(value)){
+            return constant->getBitWidth() <= 64 ? Symbol::constant(constant->getSExtValue()) : Symbol();
+        }
+        if(auto* arg = llvm::dyn_cast<llvm::Argument>(value)){
+            unsigned i = arg->getArgNo();
+            if(i < parameters.size() && isScalar(parameters[i].first)){
+                return {Symbol::AFFINE, 0, static_cast<int>(i), true};
+            }
+            return {};
+        }
+        auto it = state.values.find(value);
+        return it != state.values.end() ? it->second : Symbol();
+    }
+
+    // 按位宽把常量截断后再符号扩展, 与LLVM中该位宽整数的值一致
+    static int64_t normalize(const llvm::APInt& value){
+        return value.getBitWidth() <= 64 ? value.getSExtValue() : 0;
+    }
+
+    static bool foldBinary(unsigned opcode, unsigned bits, int64_t a, int64_t b, int64_t& result){
+        llvm::APInt x(bits, static_cast<uint64_t>(a), true), y(bits, static_cast<uint64_t>(b), true);
+        switch(opcode){
+            case llvm::Instruction::Add: result = normalize(x + y); return true;
+            case llvm::Instruction::Sub: result = normalize(x - y); return true;
+            case llvm::Instruction::Mul: result = normalize(x * y); return true;
+            case llvm::Instruction::And: result = normalize(x & y); return true;
+            case llvm::Instruction::Or: result = normalize(x | y); return true;
+            case llvm::Instruction::Xor: result = normalize(x ^ y); return true;
+            case llvm::Instruction::Shl:
+                if(y.uge(bits)){ return false; }
+                result = normalize(x.shl(y)); return true;
+            case llvm::Instruction::LShr:
+                if(y.uge(bits)){ return false; }
+                result = normalize(x.lshr(y)); return true;
+            case llvm::Instruction::AShr:
+                if(y.uge(bits)){ return false; }
+                result = normalize(x.ashr(y)); return true;
+            case llvm::Instruction::SDiv:
+                if(y == 0 || (x.isMinSignedValue() && y.getSExtValue() == -1)){ return false; }
+                result = normalize(x.sdiv(y)); return true;
+            case llvm::Instruction::UDiv:
+                if(y == 0){ return false; }
+                result = normalize(x.udiv(y)); return true;
+            case llvm::Instruction::SRem:
+                if(y == 0 || (x.isMinSignedValue() && y.getSExtValue() == -1)){ return false; }
+                result = normalize(x.srem(y)); return true;
+            case llvm::Instruction::URem:
+                if(y == 0){ return false; }
+                result = normalize(x.urem(y)); return true;
+            default: return false;
+        }
+    }
+
+    static bool foldCompare(llvm::CmpInst::Predicate predicate, unsigned bits, int64_t a, int64_t b){
+        llvm::APInt x(bits, static_cast<uint64_t>(a), true), y(bits, static_cast<uint64_t>(b), true);
+        return llvm::ICmpInst::compare(x, y, predicate);
+    }
+
+    // 解释基本块中除终结指令外的所有指令, prev为路径上的前一个基本块, 用于确定phi的值
+    void interpret(const llvm::BasicBlock* bb, const llvm::BasicBlock* prev, State& state) const {
+        for(const auto& inst : *bb){
+            if(inst.isTerminator()){
+                break;
+            }
+            if(auto* store = llvm::dyn_cast<llvm::StoreInst>(&inst)){
+                if(localSlots.count(store->getPointerOperand()) > 0){
+                    state.memory[store->getPointerOperand()] = symbolOf(store->getValueOperand(), state);
+                }
+                continue;
+            }
+            if(!inst.getType()->isIntegerTy() || inst.getType()->getIntegerBitWidth() > 64){
+                continue;
+            }
+            state.values[&inst] = evaluate(inst, prev, state);
+        }
+    }
+
+    Symbol evaluate(const llvm::Instruction& inst, const llvm::BasicBlock* prev, const State& state) const {
+        unsigned bits = inst.getType()->getIntegerBitWidth();
+        if(auto* load = llvm::dyn_cast<llvm::LoadInst>(&inst)){
+            auto it = state.memory.find(load->getPointerOperand());
+            return localSlots.count(load->getPointerOperand()) > 0 && it != state.memory.end() ? it->second : Symbol();
+        }
+        if(auto* phi = llvm::dyn_cast<llvm::PHINode>(&inst)){
+            int index = prev != nullptr ? phi->getBasicBlockIndex(prev) : -1;
+            return index >= 0 ? symbolOf(phi->getIncomingValue(index), state) : Symbol();
+        }
+        if(auto* select = llvm::dyn_cast<llvm::SelectInst>(&inst)){
+            Symbol cond = symbolOf(select->getCondition(), state);
+            if(cond.kind != Symbol::CONST){
+                return {};
+            }
+            return symbolOf(cond.value != 0 ? select->getTrueValue() : select->getFalseValue(), state);
+        }
+        if(auto* cmp = llvm::dyn_cast<llvm::ICmpInst>(&inst)){
+            Symbol a = symbolOf(cmp->getOperand(0), state), b = symbolOf(cmp->getOperand(1), state);
+            unsigned width = cmp->getOperand(0)->getType()->isIntegerTy() ? cmp->getOperand(0)->getType()->getIntegerBitWidth() : 0;
+            if(a.kind != Symbol::CONST || b.kind != Symbol::CONST || width == 0 || width > 64){
+                return {};
+            }
+            return Symbol::constant(foldCompare(cmp->getPredicate(), width, a.value, b.value) ? -1 : 0);
+        }
+        if(auto* binary = llvm::dyn_cast<llvm::BinaryOperator>(&inst)){
+            Symbol a = symbolOf(binary->getOperand(0), state), b = symbolOf(binary->getOperand(1), state);
+            auto opcode = binary->getOpcode();
+            int64_t result;
+            if(a.kind == Symbol::CONST && b.kind == Symbol::CONST){
+                return foldBinary(opcode, bits, a.value, b.value, result) ? Symbol::constant(result) : Symbol();
+            }
+            bool isAdd = opcode == llvm::Instruction::Add, isSub = opcode == llvm::Instruction::Sub;
+            if(isAdd && a.kind == Symbol::CONST){
+                std::swap(a, b);
+            }
+            if((isAdd || isSub) && a.kind == Symbol::AFFINE && b.kind == Symbol::CONST){
+                a.value += isAdd ? b.value : -b.value;
+                a.noWrap = a.noWrap && binary->hasNoSignedWrap();
+                return a;
+            }
+            return {};
+        }
+        if(auto* cast = llvm::dyn_cast<llvm::CastInst>(&inst)){
+            Symbol a = symbolOf(cast->getOperand(0), state);
+            const llvm::Type* srcType = cast->getSrcTy();
+            if(!srcType->isIntegerTy() || srcType->getIntegerBitWidth() > 64){
+                return {};
+            }
+            unsigned srcBits = srcType->getIntegerBitWidth();
+            if(a.kind == Symbol::CONST){
+                llvm::APInt x(srcBits, static_cast<uint64_t>(a.value), true);
+                switch(cast->getOpcode()){
+                    case llvm::Instruction::SExt: return Symbol::constant(normalize(x.sext(bits)));
+                    case llvm::Instruction::ZExt: return Symbol::constant(normalize(x.zext(bits)));
+                    case llvm::Instruction::Trunc: return Symbol::constant(normalize(x.trunc(bits)));
+                    default: return {};
+                }
+            }
+            if(a.kind != Symbol::AFFINE){
+                return {};
+            }
+            // 有符号参数的符号扩展和无符号参数的零扩展不改变值(偏移量的计算不溢出时)
+            bool isUnsigned = parameters[a.param].first == "uint32_t";
+            if(cast->getOpcode() == llvm::Instruction::SExt && !isUnsigned && (a.value == 0 || a.noWrap)){
+                return a;
+            }
+            if(cast->getOpcode() == llvm::Instruction::ZExt && isUnsigned && a.value == 0){
+                return a;
+            }
+            return {};
+        }
+        return {};
+    }
+
+    // 把从from到to的边对应的分支条件加到参数的取值范围上
+    EdgeResult applyEdge(llvm::BasicBlock* from, llvm::BasicBlock* to, State& state) const {
+        auto* terminator = from->getTerminator();
+        bool isSuccessor = false;
+        for(unsigned i = 0; i < terminator->getNumSuccessors(); ++i){
+            isSuccessor = isSuccessor || terminator->getSuccessor(i) == to;
+        }
+        if(!isSuccessor){
+            return EdgeResult::UNKNOWN;
+        }
+        if(auto* br = llvm::dyn_cast<llvm::BranchInst>(terminator)){
+            if(br->isUnconditional() || br->getSuccessor(0) == br->getSuccessor(1)){
+                return EdgeResult::OK;
+            }
+            return applyCondition(br->getCondition(), br->getSuccessor(0) == to, state);
+        }
+        if(auto* sw = llvm::dyn_cast<llvm::SwitchInst>(terminator)){
+            return applySwitch(sw, to, state);
+        }
+        return terminator->getNumSuccessors() <= 1 ? EdgeResult::OK : EdgeResult::UNKNOWN;
+    }
+
+    EdgeResult applyCondition(const llvm::Value* cond, bool taken, State& state) const {
+        Symbol symbol = symbolOf(cond, state);
+        if(symbol.kind == Symbol::CONST){
+            return (symbol.value != 0) == taken ? EdgeResult::OK : EdgeResult::CONFLICT;
+        }
+        // !x 在-O0下为 xor i1 %x, true
+        if(auto* binary = llvm::dyn_cast<llvm::BinaryOperator>(cond)){
+            auto* constant = llvm::dyn_cast<llvm::ConstantInt>(binary->getOperand(1));
+            if(binary->getOpcode() == llvm::Instruction::Xor && constant != nullptr && constant->isOne()){
+                return applyCondition(binary->getOperand(0), !taken, state);
+            }
+            return EdgeResult::UNKNOWN;
+        }
+        auto* cmp = llvm::dyn_cast<llvm::ICmpInst>(cond);
+        if(cmp == nullptr || !cmp->getOperand(0)->getType()->isIntegerTy()){
+            return EdgeResult::UNKNOWN;
+        }
+        auto predicate = taken ? cmp->getPredicate() : cmp->getInversePredicate();
+        Symbol lhs = symbolOf(cmp->getOperand(0), state), rhs = symbolOf(cmp->getOperand(1), state);
+        if(lhs.kind == Symbol::CONST){
+            std::swap(lhs, rhs);
+            predicate = llvm::CmpInst::getSwappedPredicate(predicate);
+        }
+        unsigned width = cmp->getOperand(0)->getType()->getIntegerBitWidth();
+        if(lhs.kind != Symbol::AFFINE || rhs.kind != Symbol::CONST || width > 62){
+            return EdgeResult::UNKNOWN;
+        }
+        const std::string& type = parameters[lhs.param].first;
+        bool isUnsigned = llvm::ICmpInst::isUnsigned(predicate) || (llvm::ICmpInst::isEquality(predicate) && type == "uint32_t");
+        llvm::APInt c(width, static_cast<uint64_t>(rhs.value), true);
+        int64_t k = (isUnsigned ? static_cast<int64_t>(c.getZExtValue()) : c.getSExtValue()) - lhs.value;
+        Domain& domain = state.domains[lhs.param];
+        restrictOperand(domain, lhs, type, width, isUnsigned);
+        switch(predicate){
+            case llvm::CmpInst::ICMP_EQ: domain.restrict(k, k); break;
+            case llvm::CmpInst::ICMP_NE: domain.excluded.insert(k); break;
+            case llvm::CmpInst::ICMP_SLT: case llvm::CmpInst::ICMP_ULT: domain.restrict(INT64_MIN, k - 1); break;
+            case llvm::CmpInst::ICMP_SLE: case llvm::CmpInst::ICMP_ULE: domain.restrict(INT64_MIN, k); break;
+            case llvm::CmpInst::ICMP_SGT: case llvm::CmpInst::ICMP_UGT: domain.restrict(k + 1, INT64_MAX); break;
+            case llvm::CmpInst::ICMP_SGE: case llvm::CmpInst::ICMP_UGE: domain.restrict(k, INT64_MAX); break;
+            default: return EdgeResult::UNKNOWN;
+        }
+        return EdgeResult::OK;
+    }
+
+    // 要求 参数 + 偏移 按比较的方式解释时不溢出, 这样比较就等价于整数上的比较。
+    // 只有带nsw标记的同位宽有符号运算(溢出是未定义行为)去掉的值不影响可行性, 其它情况去掉了值时约束不再精确
+    static void restrictOperand(Domain& domain, const Symbol& operand, const std::string& type, unsigned width, bool isUnsigned){
+        int64_t lo = isUnsigned ? 0 : -(int64_t(1) << (width - 1));
+        int64_t hi = isUnsigned ? (int64_t(1) << width) - 1 : (int64_t(1) << (width - 1)) - 1;
+        int64_t oldLo = domain.lo, oldHi = domain.hi;
+        domain.restrict(lo - operand.value, hi - operand.value);
+        bool shrank = domain.lo != oldLo || domain.hi != oldHi;
+        bool undefinedOverflow = !isUnsigned && operand.value != 0 && operand.noWrap
+                                 && type != "uint32_t" && width == typeBits(type);
+        if(shrank && !undefinedOverflow){
+            domain.exact = false;
+        }
+    }
+
+    EdgeResult applySwitch(const llvm::SwitchInst* sw, const llvm::BasicBlock* to, State& state) const {
+        Symbol symbol = symbolOf(sw->getCondition(), state);
+        if(symbol.kind == Symbol::CONST){
+            const llvm::BasicBlock* dest = sw->getDefaultDest();
+            for(const auto& caseIt : sw->cases()){
+                if(caseIt.getCaseValue()->getSExtValue() == symbol.value){
+                    dest = caseIt.getCaseSuccessor();
+                }
+            }
+            return dest == to ? EdgeResult::OK : EdgeResult::CONFLICT;
+        }
+        unsigned width = sw->getCondition()->getType()->getIntegerBitWidth();
+        if(symbol.kind != Symbol::AFFINE || width > 62){
+            return EdgeResult::UNKNOWN;
+        }
+        const std::string& type = parameters[symbol.param].first;
+        bool isUnsigned = type == "uint32_t";
+        auto caseValue = [&](const llvm::ConstantInt* value){
+            return (isUnsigned ? static_cast<int64_t>(value->getZExtValue()) : value->getSExtValue()) - symbol.value;
+        };
+        Domain& domain = state.domains[symbol.param];
+        restrictOperand(domain, symbol, type, width, isUnsigned);
+        if(sw->getDefaultDest() == to){
+            // 走默认分支: 排除所有跳到其它基本块的case值
+            for(const auto& caseIt : sw->cases()){
+                if(caseIt.getCaseSuccessor() != to){
+                    domain.excluded.insert(caseValue(caseIt.getCaseValue()));
+                }
+            }
+            return EdgeResult::OK;
+        }
+        std::vector<int64_t> caseValues;
+        for(const auto& caseIt : sw->cases()){
+            if(caseIt.getCaseSuccessor() == to){
+                caseValues.push_back(caseValue(caseIt.getCaseValue()));
+            }
+        }
+        if(caseValues.empty()){
+            return EdgeResult::UNKNOWN;
+        }
+        // 多个case跳到同一个基本块时取其中一个满足范围的值, 这时约束不再精确
+        if(caseValues.size() > 1){
+            domain.exact = false;
+        }
+        for(int64_t k : caseValues){
+            if(k >= domain.lo && k <= domain.hi && domain.excluded.count(k) == 0){
+                domain.restrict(k, k);
+                return EdgeResult::OK;
+            }
+        }
+        domain.restrict(caseValues.front(), caseValues.front());
+        return EdgeResult::OK;
+    }
+
+    // 在取值范围内选一个尽量接近0的值
+    static bool pickValue(const Domain& domain, int64_t& value){
+        if(domain.empty()){
+            return false;
+        }
+        int64_t start = std::clamp<int64_t>(0, domain.lo, domain.hi);
+        for(int64_t v = start; v <= domain.hi; ++v){
+            if(domain.excluded.count(v) == 0){
+                value = v;
+                return true;
+            }
+        }
+        for(int64_t v = start - 1; v >= domain.lo; --v){
+            if(domain.excluded.count(v) == 0){
+                value = v;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+} // namespace PCTRT
+
+#endif //PCTRT_PATHSOLVER_H
@@ -4,29 +4,238 @@
 #include <string>
 #include <utility>
 #include <vector>
+#include <map>
+#include <deque>
+#include <set>
+#include <unordered_set>
+#include <functional>
+#include <optional>
+#include <filesystem>
+#include <unistd.h>
 #include <llvm/IRReader/IRReader.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/Support/SourceMgr.h>
 #include <nlohmann/json.hpp>
 
 #include "generate/drivergenerator.h"
 #include "generate/pathinstrument.h"
+#include "generate/ktest.h"
+#include "generate/pathsolver.h"
+#include "generate/fuzzer.h"
+#include "generate/timebudget.h"
+#include "static/testcase.h"
+#include "dynamic/testengine.h"
 #include "utils/config.h"
 #include "utils/common.h"
+#include "utils/process.h"
+#include "utils/modulecache.h"
 
 namespace PCTRT {
 using json = nlohmann::json;
 
+// 一个KLEE任务的结果
+struct KleeResult {
+    std::vector<int> pathIds;               // 任务搜索的目标路径
+    std::vector<std::string> ktestFiles;    // 生成的.ktest文件
+    int maxTimeSec {0};                     // 任务的-max-time, 0表示不限制
+    bool timedOut {false};
+    bool cancelled {false};
+};
+
+/**
+ * KleeScheduler: 并发运行KLEE的任务调度器
+ * 每个任务搜索一条或多条目标路径(多条路径编码在同一个IR文件中), 输出到各自的klee-out-<IR文件名>目录,
+ * IR文件名包含函数名和第一条路径id, 同一个源文件的多个函数同时运行KLEE时输出目录不会冲突。
+ * 同时运行的任务数受CPU核数和内存限制, 每个任务通过-max-time限制时间,
+ * 超时后仍未退出的KLEE进程会被强制结束。任务结束后立即回调, 回调中可以取消其它路径的任务。
+ */
+class KleeScheduler {
+public:
+    using Callback = std::function<void(const KleeResult&)>;
+
+private:
+    struct Job {
+        size_t jobId {0};
+        std::unordered_set<int> remaining;  // 还没有被取消的目标路径
+    };
+
+    RuntimeOptions options;
+    size_t parallelism;
+    size_t unfinished {0};              // 已提交但还没有结束的任务数
+    std::unique_ptr<ProcessPool> pool;
+    std::vector<Job> jobs;
+    std::map<int, size_t> jobOfPath;    // 路径id -> jobs中的下标
+    Callback onResult;
+
+public:
+    explicit KleeScheduler(const RuntimeOptions& opts, Callback callback = nullptr)
+        : options(opts)
+        , parallelism(opts.kleeParallel > 0 ? opts.kleeParallel : defaultParallelism())
+        , onResult(std::move(callback))
+        {
+            pool = std::make_unique<ProcessPool>(parallelism);
+        }
+
+    void setCallback(Callback callback){
+        this->onResult = std::move(callback);
+    }
+
+    // 同时运行的任务数: 不超过CPU核数, 且所有任务的-max-memory之和不超过物理内存
+    static size_t defaultParallelism(){
+        size_t cores = ProcessPool::defaultParallelism();
+        long pages = sysconf(_SC_PHYS_PAGES);
+        long pageSize = sysconf(_SC_PAGE_SIZE);
+        if(pages <= 0 || pageSize <= 0){
+            return cores;
+        }
+        size_t memoryMB = static_cast<size_t>(pages) / (1024 * 1024 / static_cast<size_t>(pageSize));
+        return std::max<size_t>(1, std::min(cores, memoryMB / KLEE_MEMORY_MB));
+    }
+
+    [[nodiscard]] size_t getParallelism() const {
+        return parallelism;
+    }
+
+    [[nodiscard]] size_t active() const {
+        return unfinished;
+    }
+
+    static std::string getOutputDir(const std::string& irFile){
+        return getDirPath(irFile) + "klee-out-" + getBaseName(irFile);
+    }
+
+    // 提交一个任务, maxTimeSec为0时时间上限按目标路径数累加; 有种子时KLEE以种子模式从这些输入开始搜索
+    void submit(const std::vector<int>& pathIds, const std::string& irFile, const std::vector<std::string>& seedFiles = {}, int maxTimeSec = 0){
+        PCTRT_ASSERT(!pathIds.empty(), "KLEE job without target paths.");
+        std::string outputDir = getOutputDir(irFile);
+        std::error_code ec;
+        std::filesystem::remove_all(outputDir, ec);
+        std::vector<std::string> argv = {
+            options.kleeBin,
+            "-optimize",
+            "-output-dir=" + outputDir,
+            "-max-memory=" + std::to_string(KLEE_MEMORY_MB),
+        };
+        ProcessLimits limits;
+        limits.discardStderr = true;
+        int seconds = maxTimeSec > 0 ? maxTimeSec : options.kleeTimeoutSec * static_cast<int>(pathIds.size());
+        if(seconds > 0){
+            argv.push_back("-max-time=" + std::to_string(seconds) + "s");
+            limits.timeoutMs = (seconds + KLEE_KILL_GRACE_SEC) * 1000;
+        }
+        if(!seedFiles.empty()){
+            for(const auto& seedFile : seedFiles){
+                argv.push_back("-seed-file=" + seedFile);
+            }
+            // 复用的输入中数组和字符串的长度可能与KLEE驱动中的符号变量不同
+            argv.emplace_back("-allow-seed-extension");
+            argv.emplace_back("-allow-seed-truncation");
+            argv.emplace_back("-named-seed-matching");
+        }
+        argv.push_back(irFile);
+        size_t index = jobs.size();
+        jobs.push_back({0, {pathIds.begin(), pathIds.end()}});
+        for(int pathId : pathIds){
+            jobOfPath[pathId] = index;
+        }
+        unfinished++;
+        jobs[index].jobId = pool->submit(std::move(argv), [this, pathIds, outputDir, irFile, seconds](size_t, ProcessResult& result){
+            unfinished--;
+            KleeResult kleeResult;
+            kleeResult.pathIds = pathIds;
+            kleeResult.maxTimeSec = seconds;
+            kleeResult.timedOut = result.timedOut;
+            kleeResult.cancelled = result.cancelled;
+            if(!result.cancelled){
+                kleeResult.ktestFiles = collectKtestFiles(outputDir);
+            }
+            if(result.cancelled){
+                std::cout << "KLEE Execution Cancelled: " << irFile << std::endl;
+            }else if(result.timedOut){
+                std::cout << "KLEE Execution Timeout: " << irFile << std::endl;
+            }else{
+                std::cout << "KLEE Execution Successful: " << irFile << std::endl;
+            }
+            for(int pathId : pathIds){
+                jobOfPath.erase(pathId);
+            }
+            if(onResult){
+                onResult(kleeResult);
+            }
+        }, limits);
+    }
+
+    void submit(int pathId, const std::string& irFile){
+        submit(std::vector<int>{pathId}, irFile);
+    }
+
+    // 取消某条路径: 任务的所有目标路径都被取消后, 排队中的任务不会再启动, 运行中的KLEE进程被杀死
+    void cancel(int pathId){
+        auto it = jobOfPath.find(pathId);
+        if(it == jobOfPath.end()){
+            return;
+        }
+        Job& job = jobs[it->second];
+        jobOfPath.erase(it);
+        job.remaining.erase(pathId);
+        if(job.remaining.empty()){
+            pool->cancel(job.jobId);
+        }
+    }
+
+    void cancelAll(){
+        for(const auto& job : jobs){
+            pool->cancel(job.jobId);
+        }
+        jobOfPath.clear();
+    }
+
+    void poll(int timeoutMs){
+        pool->poll(timeoutMs);
+    }
+
+    void wait(){
+        pool->wait();
+    }
+
+private:
+    static std::vector<std::string> collectKtestFiles(const std::string& outputDir){
+        std::vector<std::string> files;
+        std::error_code ec;
+        for(const auto& entry : std::filesystem::directory_iterator(outputDir, ec)){
+            if(entry.path().extension() == ".ktest"){
+                files.push_back(entry.path().string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+};
+
 class TestGenerator {
 private:
     std::string srcName;
     std::string functionName;
     std::vector<int> paths;
+    RuntimeOptions options;
+    TestEngine* tester {nullptr};   // 新版本的执行引擎, 用于在生成测试用例后立即计算覆盖的路径
+    const TestSuite* seedSuite {nullptr};   // 复用得到的测试套件, 其中的输入作为KLEE的种子
 
 public:
-    explicit TestGenerator(std::string src, std::string func, std::vector<int> paths)
-      : srcName(std::move(src)), functionName(std::move(func)), paths(std::move(paths)) {}
+    explicit TestGenerator(std::string src, std::string func, std::vector<int> paths, const RuntimeOptions& opts = {})
+      : srcName(std::move(src)), functionName(std::move(func)), paths(std::move(paths)), options(opts) {}
+
+    void setTester(TestEngine* engine){
+        this->tester = engine;
+    }
+
+    void setSeedSuite(const TestSuite* suite){
+        this->seedSuite = suite;
+    }
 
-    bool run(){
+    // 为未覆盖的路径生成测试用例, 生成的测试用例追加到generated中
+    bool run(TestSuite& generated){
         // 首先生成驱动函数
         auto kleeDriverGenerator = DriverGenerator(srcName);
         auto driverFile = kleeDriverGenerator.generate(functionName, DRIVER_TYPE::DRIVER_KLEE_SE);
@@ -39,15 +248,116 @@ public:
                 exit(1);
             }
         }
+        auto parameters = kleeDriverGenerator.getParameters(functionName);
         // 将驱动函数文件编译为LLVM IR
-        driverFile = getDirPath(srcName) + getBaseName(srcName) + "_klee_driver.c";
-        std::string driverIRFile = getDirPath(srcName) + getBaseName(srcName) + "_klee_driver.ll";
+        driverFile = DriverGenerator::getDriverFile(srcName, functionName, DRIVER_TYPE::DRIVER_KLEE_SE);
+        std::string driverIRFile = getDirPath(driverFile) + getBaseName(driverFile) + ".ll";
         std::cout << "Compiling driver file: " << driverFile << " to " << driverIRFile << std::endl;
-        bool compiled = compileSrcToIR(driverFile, driverIRFile);
+        bool compiled = ModuleCache::compile(driverFile, driverIRFile);
         PCTRT_ASSERT(compiled, "Failed to compile driver file.");
-        // 对LLVM IR插桩
-        std::string klee_cmd = KLEE_SCRIPT;
-        for(int path_id : paths){
+        std::unordered_set<int> pending(paths.begin(), paths.end());
+        KleeScheduler scheduler(options);
+        TimeBudget budget(options.generateBudgetSec, scheduler.getParallelism());
+        // 先静态分析: 去掉不可行的路径, 用轻量级求解器处理只含简单整数比较的路径, 其余的路径才交给KLEE
+        if(options.pruneInfeasible || options.fastSolve){
+            analyzePaths(driverIRFile, parameters, pending, generated);
+        }
+        // 然后变异复用的测试用例, 廉价地覆盖容易到达的路径
+        if(options.fuzzRounds > 0 && tester != nullptr && seedSuite != nullptr && !pending.empty()){
+            fuzzUncoveredPaths(driverIRFile, parameters, pending, generated, budget.getDeadline());
+        }
+        // 对LLVM IR插桩, 每组路径生成一个IR文件后立即交给调度器, 插桩和符号执行同时进行
+        // 每个任务结束后立即解析它生成的ktest文件, 按对象数据去重后转换为测试用例;
+        // 设置了执行引擎时, 新的测试用例立即在新版本上执行, 它覆盖的其它路径不再需要KLEE, 相应的任务被取消。
+        // 有全局时间预算时, 超时且仍未覆盖的目标路径在预算允许时以更高的权重重新排队
+        std::unordered_set<uint64_t> seen;
+        std::deque<int> queue(paths.begin(), paths.end());
+        std::unordered_map<int, int> attempts;
+        size_t retired = 0;
+        scheduler.setCallback([&](const KleeResult& result){
+            budget.refund(result.maxTimeSec);
+            std::string targets;
+            for(int pathId : result.pathIds){
+                targets += (targets.empty() ? "" : ", ") + std::to_string(pathId);
+            }
+            TestSuite batch;
+            for(const auto& file : result.ktestFiles){
+                KTest ktest;
+                if(!KTest::fromFile(file, ktest) || !seen.insert(ktest.dataHash()).second){
+                    continue;
+                }
+                TestCase tc;
+                tc.description = "test case generated by klee for path " + targets;
+                if(ktest.toTestCase(parameters, tc)){
+                    batch.addTestCase(std::move(tc));
+                }
+            }
+            std::unordered_set<int> own(result.pathIds.begin(), result.pathIds.end());
+            for(int pathId : executeGenerated(batch, generated)){
+                if(pending.erase(pathId) > 0 && own.count(pathId) == 0){
+                    std::cout << "Path " << pathId << " covered by test case generated for path " << targets << std::endl;
+                    scheduler.cancel(pathId);
+                    retired++;
+                }
+            }
+            // KLEE通常在-max-time到达时自行结束, 所以不论是正常退出还是被杀死, 目标路径仍未覆盖就算一次失败的尝试
+            for(int pathId : result.pathIds){
+                bool failed = !result.cancelled && pending.count(pathId) > 0;
+                if(failed){
+                    ++attempts[pathId];
+                }
+                bool retry = failed && budget.isLimited() && !budget.exhausted() && tester != nullptr
+                             && attempts[pathId] < KLEE_MAX_ATTEMPTS;
+                if(retry){
+                    queue.push_back(pathId);
+                }else{
+                    pending.erase(pathId);
+                }
+            }
+        });
+        // 每个KLEE任务同时搜索最多kleeTargetsPerJob条路径
+        std::cout << "Running klee on instrumented IR files..." << std::endl;
+        size_t targetsPerJob = std::max<size_t>(1, options.kleeTargetsPerJob);
+        std::shared_ptr<const UniqueSubSeqIndex> uniqueIndex;     // 每条路径的唯一子序列只计算一次
+        std::vector<double> weights = budget.isLimited() ? pathWeights(driverIRFile) : std::vector<double>();
+        auto weightOf = [&](int pathId){
+            double weight = pathId >= 0 && pathId < weights.size() ? weights[pathId] : 1.0;
+            return weight * (1 + attempts[pathId]);
+        };
+        while(true){
+            // 处理已经结束的任务, 已被覆盖的路径不再插桩和提交
+            scheduler.poll(0);
+            // 有时间预算时任务在有空闲位置时才提交, 以便用上前面的任务归还的时间
+            if(budget.isLimited() && scheduler.active() >= scheduler.getParallelism()){
+                scheduler.poll(-1);
+                continue;
+            }
+            std::vector<int> group;
+            while(!queue.empty() && group.size() < targetsPerJob){
+                int pathId = queue.front();
+                queue.pop_front();
+                if(pending.count(pathId) > 0 && std::find(group.begin(), group.end(), pathId) == group.end()){
+                    group.push_back(pathId);
+                }
+            }
+            if(group.empty()){
+                if(scheduler.active() == 0){
+                    break;
+                }
+                scheduler.poll(-1);
+                continue;
+            }
+            if(budget.exhausted()){
+                std::cout << "Generation budget exhausted, " << group.size() + queue.size() << " paths are not searched by klee." << std::endl;
+                break;
+            }
+            double groupWeight = 0, pendingWeight = 0;
+            for(int pathId : group){
+                groupWeight += weightOf(pathId);
+            }
+            for(int pathId : queue){
+                pendingWeight += pending.count(pathId) > 0 ? weightOf(pathId) : 0;
+            }
             llvm::LLVMContext ctx;
             llvm::SMDiagnostic err;
             auto ptr = llvm::parseIRFile(driverIRFile, err, ctx);
@@ -55,23 +365,259 @@ public:
                 std::cerr << "Failed to parse IR file: " << driverIRFile << std::endl;
                 return false;
             }
-            PathInstrument pi(std::move(ptr), functionName);
-            std::string irFileName = getDirPath(srcName) + functionName + "_klee_instrumented_" + std::to_string(path_id) + ".ll";
-            pi.generateInstrumentedIR(path_id, irFileName);
-            
-            klee_cmd += " " + irFileName;
+            PathInstrument pi(std::move(ptr), functionName, uniqueIndex);
+            uniqueIndex = pi.getUniqueIndex();
+            std::string irFileName = getDirPath(srcName) + functionName + "_klee_instrumented_" + std::to_string(group.front()) + ".ll";
+            auto targets = pi.generateInstrumentedIR(group, irFileName);
+            for(int pathId : group){
+                if(std::find(targets.begin(), targets.end(), pathId) == targets.end()){
+                    std::cout << "Cannot instrument path " << pathId << " for klee." << std::endl;
+                    pending.erase(pathId);
+                }
+            }
+            // 解析和插桩也要花时间, 分配前再检查一次预算
+            if(!targets.empty() && budget.exhausted()){
+                std::cout << "Generation budget exhausted, " << targets.size() + queue.size() << " paths are not searched by klee." << std::endl;
+                break;
+            }
+            if(!targets.empty()){
+                auto seedDir = getDirPath(irFileName) + "klee-seeds-" + getBaseName(irFileName);
+                int maxTime = budget.allot(groupWeight, groupWeight + pendingWeight);
+                scheduler.submit(targets, irFileName, writeSeeds(targets, parameters, seedDir), maxTime);
+            }
         }
-        // 使用klee对插桩后的IR文件进行符号执行
-        std::cout << "klee_cmd: " << klee_cmd << "\n";
-        std::cout << "Running klee on instrumented IR files..." << std::endl;
-        int ret = system(klee_cmd.c_str());
-        if(ret != 0){
-            std::cerr << "Failed to run klee on instrumented IR files." << std::endl;
+        scheduler.wait();
+        std::cout << "Generated " << seen.size() << " unique test cases by klee, "
+                  << retired << " paths covered by test cases generated for other paths." << std::endl;
+        return true;
+    }
+
+private:
+    // 在新版本上执行生成的测试用例并加入generated, 返回它们覆盖的路径; 没有执行引擎时返回空
+    std::vector<int> executeGenerated(TestSuite& batch, TestSuite& generated){
+        std::vector<int> covered;
+        if(tester != nullptr && !batch.testCases.empty()){
+            std::vector<std::string> outputs;
+            tester->run(batch, outputs);
+            for(size_t i = 0; i < outputs.size(); ++i){
+                if(batch.testCases[i].isAbnormal()){
+                    continue;
+                }
+                for(int pathId : tester->getCFG().matchPathIds(outputs[i])){
+                    covered.push_back(pathId);
+                }
+            }
+        }
+        for(auto& tc : batch.testCases){
+            generated.addTestCase(std::move(tc));
+        }
+        return covered;
+    }
+
+    // 在驱动的LLVM IR上静态分析每条待处理的路径。
+    // 1. 剪枝: 证明不可能被覆盖的路径从pending中移除, 记录到generated的infeasiblePaths中;
+    // 2. 求解: 用PathSolver为只含简单条件的路径求输入。有执行引擎时以实际执行的覆盖情况为准,
+    //    只有确实被覆盖的路径才从pending中移除; 否则相信求解的结果
+    void analyzePaths(const std::string& irFile, const KTest::Parameters& parameters,
+                      std::unordered_set<int>& pending, TestSuite& generated){
+        llvm::Module* module = ModuleCache::get(irFile);
+        llvm::Function* function = module ? module->getFunction(functionName) : nullptr;
+        if(function == nullptr){
+            return;
+        }
+        CFG cfg;
+        cfg.initGraphFromFunction(function);
+        auto& cfgPaths = cfg.getPaths();
+        PathSolver solver(function, parameters);
+        std::vector<std::optional<PathSolver::Verdict>> verdicts(cfgPaths.size());
+        std::vector<TestCase> solutions(cfgPaths.size());
+        auto verdictOf = [&](int pathId){
+            if(!verdicts[pathId]){
+                verdicts[pathId] = solver.check(cfgPaths[pathId].to_vector_of_nodes(), solutions[pathId]);
+            }
+            return *verdicts[pathId];
+        };
+        bool reentrant = options.pruneInfeasible && mayReenter(function);
+        if(reentrant){
+            std::cout << "Function " << functionName << " may re-enter itself, skip infeasible path pruning." << std::endl;
+        }
+        if(options.pruneInfeasible && !reentrant){
+            std::vector<int> infeasible = generated.getInfeasiblePaths();
+            for(int pathId : paths){
+                if(pathId >= 0 && pathId < cfgPaths.size() && pending.count(pathId) > 0
+                   && isUncoverable(cfg, pathId, verdictOf)){
+                    pending.erase(pathId);
+                    infeasible.push_back(pathId);
+                    std::cout << "Path " << pathId << " is infeasible: " << cfgPaths[pathId].to_string_with_nodes() << std::endl;
+                }
+            }
+            generated.setInfeasiblePaths(infeasible);
+        }
+        if(!options.fastSolve){
+            return;
+        }
+        TestSuite batch;
+        std::vector<int> solved;
+        for(int pathId : paths){
+            if(pathId < 0 || pathId >= cfgPaths.size() || pending.count(pathId) == 0 || verdictOf(pathId) != PathSolver::Verdict::SOLVED){
+                continue;
+            }
+            TestCase tc = solutions[pathId];
+            tc.description = "test case generated by path solver for path " + std::to_string(pathId);
+            batch.addTestCase(std::move(tc));
+            solved.push_back(pathId);
+        }
+        auto covered = executeGenerated(batch, generated);
+        if(tester == nullptr){
+            covered = solved;
+        }
+        size_t count = 0;
+        for(int pathId : covered){
+            count += pending.erase(pathId);
+        }
+        std::cout << "Path solver generated " << solved.size() << " test cases, "
+                  << count << " uncovered paths covered without klee." << std::endl;
+    }
+
+    // 执行覆盖了一条路径的所有基本块即算覆盖了它, 所以只证明基本块序列不可行还不够。
+    // 函数中没有循环且不会重入(由调用者用mayReenter保证)时, 每次执行都恰好是一条静态路径,
+    // 这时路径及所有包含它全部基本块的路径都不可行, 它才不可能被覆盖
+    template<typename VerdictOf>
+    static bool isUncoverable(CFG& cfg, int pathId, VerdictOf& verdictOf){
+        if(cfg.hasLoops() || verdictOf(pathId) != PathSolver::Verdict::INFEASIBLE){
             return false;
         }
+        auto& cfgPaths = cfg.getPaths();
+        for(auto& path : cfgPaths){
+            if(path.getId() == pathId || !path.covers(cfgPaths[pathId])){
+                continue;
+            }
+            if(verdictOf(path.getId()) != PathSolver::Verdict::INFEASIBLE){
+                return false;
+            }
+        }
         return true;
     }
 
+    // 函数可能在一次执行中被再次调用时返回true: 直接或间接递归、经过函数指针的调用,
+    // 或者地址被取用时调用了外部函数(外部函数可能通过函数指针回调它)。
+    // 基本块标记是全局的, 重入时多个栈帧的覆盖情况合并在一起, 可能覆盖单个栈帧内不可行的路径
+    static bool mayReenter(llvm::Function* function){
+        std::vector<llvm::Function*> worklist {function};
+        std::unordered_set<llvm::Function*> visited {function};
+        while(!worklist.empty()){
+            llvm::Function* current = worklist.back();
+            worklist.pop_back();
+            for(auto& inst : llvm::instructions(current)){
+                auto* call = llvm::dyn_cast<llvm::CallBase>(&inst);
+                if(call == nullptr){
+                    continue;
+                }
+                llvm::Function* callee = call->getCalledFunction();
+                if(callee == nullptr || callee == function){
+                    return true;
+                }
+                if(callee->isIntrinsic()){
+                    continue;
+                }
+                if(callee->isDeclaration()){
+                    if(function->hasAddressTaken()){
+                        return true;
+                    }
+                    continue;
+                }
+                if(visited.insert(callee).second){
+                    worklist.push_back(callee);
+                }
+            }
+        }
+        return false;
+    }
+
+    void fuzzUncoveredPaths(const std::string& irFile, const KTest::Parameters& parameters,
+                            std::unordered_set<int>& pending, TestSuite& generated, TimeBudget::Clock::time_point deadline){
+        Fuzzer fuzzer(*tester, parameters);
+        fuzzer.setDeadline(deadline);
+        llvm::Module* module = ModuleCache::get(irFile);
+        if(llvm::Function* function = module ? module->getFunction(functionName) : nullptr){
+            fuzzer.addDictionary(function);
+        }
+        for(const auto& tc : seedSuite->testCases){
+            fuzzer.addSeed(tc);
+        }
+        size_t before = pending.size();
+        TestSuite kept;
+        fuzzer.run(options.fuzzRounds, pending, kept);
+        for(auto& tc : kept.testCases){
+            generated.addTestCase(std::move(tc));
+        }
+        std::cout << "Fuzzer kept " << kept.testCases.size() << " test cases, "
+                  << before - pending.size() << " uncovered paths covered without klee." << std::endl;
+    }
+
+    // 估计每条路径的求解难度: 条件分支越多、路径越长, 分配的时间越多
+    std::vector<double> pathWeights(const std::string& irFile){
+        llvm::Module* module = ModuleCache::get(irFile);
+        llvm::Function* function = module ? module->getFunction(functionName) : nullptr;
+        if(function == nullptr){
+            return {};
+        }
+        CFG cfg;
+        cfg.initGraphFromFunction(function);
+        std::vector<double> weights;
+        for(auto& path : cfg.getPaths()){
+            auto seq = path.to_vector_of_nodes();
+            size_t branches = 0;
+            for(size_t i = 0; i + 1 < seq.size(); ++i){
+                branches += cfg.getBlockSuccessors(seq[i]).size() > 1;
+            }
+            weights.push_back(1.0 + static_cast<double>(branches) + KLEE_WEIGHT_PER_BLOCK * static_cast<double>(seq.size()));
+        }
+        return weights;
+    }
+
+    // 为每条目标路径挑选执行路径与它公共前缀最长的kleeSeeds个复用测试用例, 写成ktest种子文件
+    std::vector<std::string> writeSeeds(const std::vector<int>& targets, const KTest::Parameters& parameters, const std::string& seedDir){
+        if(tester == nullptr || seedSuite == nullptr || options.kleeSeeds == 0){
+            return {};
+        }
+        auto& cfgPaths = tester->getCFG().getPaths();
+        std::set<size_t> chosen;
+        for(int target : targets){
+            auto targetSeq = cfgPaths[target].to_vector_of_nodes();
+            std::vector<std::pair<size_t, size_t>> candidates;  // (公共前缀长度, 测试用例下标)
+            for(size_t i = 0; i < seedSuite->testCases.size(); ++i){
+                int pathId = seedSuite->testCases[i].getPathId();
+                if(pathId < 0 || pathId >= cfgPaths.size()){
+                    continue;
+                }
+                auto seq = cfgPaths[pathId].to_vector_of_nodes();
+                auto mismatch = std::mismatch(targetSeq.begin(), targetSeq.end(), seq.begin(), seq.end());
+                candidates.emplace_back(mismatch.first - targetSeq.begin(), i);
+            }
+            size_t count = std::min(candidates.size(), options.kleeSeeds);
+            std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+                              [](const auto& a, const auto& b){ return a.first > b.first; });
+            for(size_t k = 0; k < count; ++k){
+                chosen.insert(candidates[k].second);
+            }
+        }
+        std::vector<std::string> seedFiles;
+        if(chosen.empty()){
+            return seedFiles;
+        }
+        std::error_code ec;
+        std::filesystem::remove_all(seedDir, ec);
+        std::filesystem::create_directories(seedDir, ec);
+        for(size_t i : chosen){
+            std::string seedFile = seedDir + "/seed" + std::to_string(i) + ".ktest";
+            if(KTest::fromTestCase(parameters, seedSuite->testCases[i]).toFile(seedFile)){
+                seedFiles.push_back(seedFile);
+            }
+        }
+        return seedFiles;
+    }
+
 
 }; // class TestGenerator
 
@@ -0,0 +1,75 @@
+#ifndef PCTRT_TIMEBUDGET_H
+#define PCTRT_TIMEBUDGET_H
+
+#include <chrono>
+#include <algorithm>
+
+#include "utils/config.h"
+
+namespace PCTRT
+{
+
+/**
+ * TimeBudget: 测试生成阶段的全局时间预算
+ * 预算按墙钟计算, 同时运行slots个KLEE任务时可分配的总时间为 剩余墙钟时间 × slots。
+ * 每个任务提交时按它的目标路径的权重占所有待处理路径权重的比例, 从尚未分配的时间中分得一份;
+ * 任务结束后它的份额被归还, 提前结束省下的时间自然留给后面的任务。
+ * 总时间为0时不限制, allot()返回0, 由调用者使用固定的单路径超时。
+ */
+class TimeBudget {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    bool limited;
+    Clock::time_point deadline;
+    size_t slots;
+    double reserved {0};    // 已分配给未结束任务的时间(秒)
+
+public:
+    TimeBudget(int totalSec, size_t parallel)
+        : limited(totalSec > 0)
+        , deadline(Clock::now() + std::chrono::seconds(std::max(totalSec, 0)))
+        , slots(std::max<size_t>(1, parallel))
+        {}
+
+    [[nodiscard]] bool isLimited() const {
+        return limited;
+    }
+
+    [[nodiscard]] Clock::time_point getDeadline() const {
+        return limited ? deadline : Clock::time_point::max();
+    }
+
+    [[nodiscard]] double remainingWall() const {
+        return std::chrono::duration<double>(deadline - Clock::now()).count();
+    }
+
+    // 剩余时间已不够运行一个最短的任务
+    [[nodiscard]] bool exhausted() const {
+        return limited && remainingWall() < KLEE_MIN_TIME_SEC;
+    }
+
+    // 为权重为weight的任务分配时间, pendingWeight为包括它在内所有还没有分配时间的路径的权重之和
+    int allot(double weight, double pendingWeight){
+        if(!limited){
+            return 0;
+        }
+        double wall = remainingWall();
+        double pool = std::max(0.0, wall * static_cast<double>(slots) - reserved);
+        double share = pendingWeight > 0 ? pool * weight / pendingWeight : pool;
+        // 剩余墙钟时间可能已经少于最短任务时间, 上界不能小于下界
+        double minTime = static_cast<double>(KLEE_MIN_TIME_SEC);
+        int seconds = static_cast<int>(std::clamp(share, minTime, std::max(wall, minTime)));
+        reserved += seconds;
+        return seconds;
+    }
+
+    void refund(int seconds){
+        reserved = std::max(0.0, reserved - seconds);
+    }
+};
+
+} // namespace PCTRT
+
+#endif //PCTRT_TIMEBUDGET_H
@@ -3,8 +3,9 @@
 #include <filesystem>
 #include <llvm/Support/CommandLine.h>
 
-#include "dynamic/reuseengine.h"
-#include "generate/testgenerator.h"
+#include "runner/reusejob.h"
+#include "runner/manifest.h"
+#include "runner/server.h"
 
 using namespace llvm;
 using namespace PCTRT;
@@ -15,52 +16,230 @@ static cl::opt<std::string> Directory("d", cl::desc("Specify the directory"), cl
 static cl::opt<std::string> OldSrcFile("old", cl::desc("Specify the old source file"), cl::value_desc("old source file"));
 static cl::opt<std::string> NewSrcFile("new", cl::desc("Specify the new source file"), cl::value_desc("new source file"));
 static cl::opt<std::string> FunctionName("func", cl::desc("Specify the function name"), cl::value_desc("function name"));
+static cl::opt<std::string> FunctionPatterns("funcs", cl::desc("Process several functions in one run: comma separated names or glob patterns ('*' = every function defined in both versions); the test json file name must contain {func}"), cl::value_desc("functions"));
+static cl::opt<unsigned> FunctionJobs("func-jobs", cl::desc("Number of functions processed concurrently with -funcs or -manifest (0 = number of cores)"), cl::init(0));
+static cl::opt<std::string> ManifestFile("manifest", cl::desc("Run all (old, new, func, test) jobs listed in a json manifest instead of a single function"), cl::value_desc("manifest file"));
+static cl::opt<std::string> WorkspaceDir("workspace", cl::desc("Directory in which the per-run workspace is created (default: /dev/shm, or the system temp directory)"), cl::value_desc("directory"));
+static cl::opt<bool> KeepWorkspace("keep-workspace", cl::desc("Keep the workspace with all intermediate files after the run"), cl::init(false));
+static cl::opt<std::string> ServeSocket("serve", cl::desc("Run as a server listening on a Unix domain socket, keeping compiled modules, CFGs and caches warm between requests"), cl::value_desc("socket"));
+static cl::opt<std::string> ConnectSocket("connect", cl::desc("Send the -old/-new/-func/-test job to a running server instead of processing it here (without a job: ping the server)"), cl::value_desc("socket"));
+static cl::opt<bool> StopServer("stop", cl::desc("With -connect: ask the server to shut down"), cl::init(false));
+static cl::opt<std::string> ConvertSuite("convert", cl::desc("Convert a test suite between JSON and the compact binary format (.pcts) and exit"), cl::value_desc("test suite file"));
+static cl::opt<std::string> ConvertOutput("convert-to", cl::desc("Output of -convert (default: the same name with the other extension)"), cl::value_desc("test suite file"));
+static cl::opt<std::string> ReportFile("report", cl::desc("Aggregated report of a manifest run (default: <manifest>_report.json)"), cl::value_desc("report file"));
 static cl::opt<std::string> TestJsonFile("test", cl::desc("Specify the test json file"), cl::value_desc("test json file"));
 static cl::opt<std::string> CFGoption("cfg", cl::desc("Option to draw the new cfg image"), cl::value_desc("cfg option"));
+static cl::opt<bool> OptimizeExec("opt-exec", cl::desc("Build the instrumented test executables with optimization enabled"), cl::init(false));
+static cl::opt<bool> BatchDriver("batch", cl::desc("Run all test cases in one process through a binary input stream (forks per test case when the source has writable static state)"), cl::init(false));
+static cl::opt<unsigned> ExecJobs("exec-jobs", cl::desc("Number of test processes to run concurrently (0 = number of cores)"), cl::init(0));
+static cl::opt<int> ExecTimeout("exec-timeout", cl::desc("Wall-clock timeout of each test case in milliseconds (0 = unlimited)"), cl::init(EXEC_TIMEOUT_MS));
+static cl::opt<int> ExecCpuLimit("exec-cpu", cl::desc("CPU time limit of each test case in seconds (0 = unlimited)"), cl::init(EXEC_CPU_LIMIT_SEC));
+static cl::opt<unsigned> ExecMemoryLimit("exec-mem", cl::desc("Address space limit of each test process in MB (0 = unlimited)"), cl::init(EXEC_MEMORY_LIMIT_MB));
+static cl::opt<std::string> ExecCache("exec-cache", cl::desc("Execution result cache file (default: <test json>_exec_cache.json, 'none' to disable)"), cl::value_desc("cache file"));
+static cl::opt<std::string> KleeBin("klee", cl::desc("Path of the KLEE executable"), cl::value_desc("klee"), cl::init(KLEE_BIN));
+static cl::opt<unsigned> KleeJobs("klee-jobs", cl::desc("Number of KLEE processes to run concurrently (0 = by cores and memory)"), cl::init(0));
+static cl::opt<int> KleeTimeout("klee-timeout", cl::desc("KLEE time limit per uncovered path in seconds (0 = unlimited)"), cl::init(KLEE_TIMEOUT_SEC));
+static cl::opt<unsigned> KleeTargets("klee-targets", cl::desc("Number of uncovered paths searched by one KLEE run (needs patch 0002)"), cl::init(KLEE_TARGETS_PER_JOB));
+static cl::opt<int> GenerateBudget("gen-budget", cl::desc("Global time budget in seconds for test generation, shared by all uncovered paths (0 = fixed per-path KLEE timeout)"), cl::init(0));
+static cl::opt<unsigned> KleeSeeds("klee-seeds", cl::desc("Number of reused test cases used as KLEE seeds for each uncovered path (0 = no seeding)"), cl::init(KLEE_SEEDS_PER_PATH));
+static cl::opt<bool> FastSolve("fast-solve", cl::desc("Solve paths guarded only by simple integer comparisons before running KLEE"), cl::init(true));
+static cl::opt<bool> PruneInfeasible("prune-infeasible", cl::desc("Skip uncovered paths that static analysis proves infeasible"), cl::init(true));
+static cl::opt<unsigned> FuzzRounds("fuzz-rounds", cl::desc("Rounds of coverage-guided mutation of reused test cases before running KLEE (0 = no fuzzing)"), cl::init(FUZZ_ROUNDS));
+static cl::opt<bool> MinimalProbes("min-probe", cl::desc("Only instrument the blocks whose coverage cannot be derived from other blocks"), cl::init(false));
 
-int main(int argc, char **argv) {
-    cl::ParseCommandLineOptions(argc, argv, "My tool description\n");
-    // 访问解析后的参数
-    std::string oldSrcFile, newSrcFile, functionName, testJsonFile;
-    if(OldSrcFile.empty() || NewSrcFile.empty() || FunctionName.empty() || TestJsonFile.empty()){
+// 处理多个函数: 旧版本的测试套件文件名中的{func}替换为函数名, 所有函数共用编译结果和新版本旁边的执行结果缓存
+static int runFunctions(const RuntimeOptions& options, Workspace& workspace){
+    const std::string placeholder = "{func}";
+    if(TestJsonFile.find(placeholder) == std::string::npos){
+        std::cerr << "The test json file must contain " << placeholder << " when processing several functions\n";
+        return 1;
+    }
+    if(!CFGoption.empty()){
+        std::cout << "Ignore -cfg when processing several functions\n";
+    }
+    auto functions = listFunctions(stageSource(workspace, OldSrcFile), stageSource(workspace, NewSrcFile), FunctionPatterns);
+    if(functions.empty()){
+        std::cerr << "No function matches " << FunctionPatterns << "\n";
+        return 1;
+    }
+    std::string cacheFile = options.execCacheFile;
+    if(cacheFile.empty()){
+        cacheFile = getDirPath(NewSrcFile) + getBaseName(NewSrcFile) + "_exec_cache.json";
+    }
+    std::vector<ReuseJob> jobs;
+    for(const auto& function : functions){
+        ReuseJob job;
+        job.oldSrcFile = OldSrcFile;
+        job.newSrcFile = NewSrcFile;
+        job.functionName = function;
+        job.testJsonFile = TestJsonFile;
+        job.testJsonFile.replace(job.testJsonFile.find(placeholder), placeholder.size(), function);
+        job.outputFile = getDirPath(job.testJsonFile) + getBaseName(job.testJsonFile) + "_reused" + suiteExtension(job.testJsonFile);
+        job.cacheFile = cacheFile;
+        jobs.push_back(std::move(job));
+    }
+    std::cout << "Processing " << jobs.size() << " functions of " << NewSrcFile << "\n";
+    JobRunner runner(options, workspace);
+    auto reports = runner.run(jobs);
+    size_t failed = printJobReports(reports);
+    return failed == 0 ? 0 : 1;
+}
+
+// 按任务清单处理多个源文件中的函数, 所有任务的结果汇总到一个报告中
+static int runManifest(const RuntimeOptions& options, Workspace& workspace){
+    std::vector<ReuseJob> jobs;
+    if(!loadManifest(ManifestFile, options, jobs)){
+        return 1;
+    }
+    if(jobs.empty()){
+        std::cerr << "No job in manifest " << ManifestFile << "\n";
+        return 1;
+    }
+    std::cout << "Processing " << jobs.size() << " jobs of " << ManifestFile << "\n";
+    JobRunner runner(options, workspace);
+    auto reports = runner.run(jobs);
+    size_t failed = printJobReports(reports);
+    std::string reportFile = ReportFile;
+    if(reportFile.empty()){
+        reportFile = getDirPath(ManifestFile) + getBaseName(ManifestFile) + "_report.json";
+    }
+    dumpJobReports(jobs, reports, reportFile);
+    return failed == 0 ? 0 : 1;
+}
+
+// 把一个任务发送给常驻进程, 路径转为绝对路径后与常驻进程的工作目录无关
+static int runClient(){
+    nlohmann::json request;
+    if(StopServer){
+        request["cmd"] = "shutdown";
+    }else if(OldSrcFile.empty() && NewSrcFile.empty() && FunctionName.empty() && TestJsonFile.empty()){
+        request["cmd"] = "ping";
+    }else if(OldSrcFile.empty() || NewSrcFile.empty() || FunctionName.empty() || TestJsonFile.empty()){
         std::cerr << "You must specify the old source file, new source file, function name and test json file\n";
         return 1;
+    }else{
+        request["old"] = fs::absolute(OldSrcFile.getValue()).string();
+        request["new"] = fs::absolute(NewSrcFile.getValue()).string();
+        request["func"] = FunctionName.getValue();
+        request["test"] = fs::absolute(TestJsonFile.getValue()).string();
+        if(!ExecCache.empty()){
+            request["cache"] = ExecCache == "none" ? std::string("none") : fs::absolute(ExecCache.getValue()).string();
+        }
+    }
+    std::string response;
+    if(!ReuseServer::sendRequest(ConnectSocket, request.dump(), response)){
+        return 1;
     }
-    // 确保OldSrcFile, NewSrcFile, TestJsonFile文件都存在
-    if(!fs::exists(OldSrcFile.c_str())){
-        std::cerr << "Old source file " << OldSrcFile << " does not exist\n";
+    std::cout << response << "\n";
+    auto j = nlohmann::json::parse(response, nullptr, false);
+    return !j.is_discarded() && j.value("success", false) ? 0 : 1;
+}
+
+// JSON和.pcts格式的测试套件互相转换
+static int runConvert(){
+    if(!fs::exists(ConvertSuite.c_str())){
+        std::cerr << "Test suite file " << ConvertSuite << " does not exist\n";
         return 1;
     }
-    if(!fs::exists(NewSrcFile.c_str())){
-        std::cerr << "New source file " << NewSrcFile << " does not exist\n";
+    std::string output = ConvertOutput;
+    if(output.empty()){
+        output = getDirPath(ConvertSuite) + getBaseName(ConvertSuite) + (CompactSuite::isCompactFile(ConvertSuite) ? ".json" : PCTS_EXTENSION);
+    }
+    TestSuite ts;
+    if(!loadTestSuite(ConvertSuite, ts) || !dumpTestSuite(ts, output)){
         return 1;
     }
-    if(!fs::exists(TestJsonFile.c_str())){
-        std::cerr << "Test json file " << TestJsonFile << " does not exist\n";
+    std::cout << "Test suite with " << ts.testCases.size() << " test cases written to " << output << "\n";
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "My tool description\n");
+    if(!ConvertSuite.empty()){
+        return runConvert();
+    }
+    if(!ConnectSocket.empty()){
+        return runClient();
+    }
+    // 访问解析后的参数
+    std::string oldSrcFile, newSrcFile, functionName, testJsonFile;
+    bool multiple = !FunctionPatterns.empty();
+    if(!ServeSocket.empty()){
+        // 常驻进程的任务来自请求, 不需要命令行中的源文件
+    }else if(!ManifestFile.empty()){
+        if(!fs::exists(ManifestFile.c_str())){
+            std::cerr << "Manifest file " << ManifestFile << " does not exist\n";
+            return 1;
+        }
+    }else{
+        if(OldSrcFile.empty() || NewSrcFile.empty() || (FunctionName.empty() && !multiple) || TestJsonFile.empty()){
+            std::cerr << "You must specify the old source file, new source file, function name and test json file\n";
+            return 1;
+        }
+        // 确保OldSrcFile, NewSrcFile, TestJsonFile文件都存在
+        if(!fs::exists(OldSrcFile.c_str())){
+            std::cerr << "Old source file " << OldSrcFile << " does not exist\n";
+            return 1;
+        }
+        if(!fs::exists(NewSrcFile.c_str())){
+            std::cerr << "New source file " << NewSrcFile << " does not exist\n";
+            return 1;
+        }
+        if(!multiple && !fs::exists(TestJsonFile.c_str())){
+            std::cerr << "Test json file " << TestJsonFile << " does not exist\n";
+            return 1;
+        }
+    }
+    RuntimeOptions options;
+    options.optimizeExec = OptimizeExec;
+    options.minimalProbes = MinimalProbes;
+    options.batchDriver = BatchDriver;
+    options.execParallel = ExecJobs;
+    options.execTimeoutMs = ExecTimeout;
+    options.execCpuSeconds = ExecCpuLimit;
+    options.execMemoryMB = ExecMemoryLimit;
+    options.execCacheFile = ExecCache;
+    options.kleeBin = KleeBin;
+    options.kleeParallel = KleeJobs;
+    options.kleeTimeoutSec = KleeTimeout;
+    options.kleeTargetsPerJob = KleeTargets;
+    options.kleeSeeds = KleeSeeds;
+    options.generateBudgetSec = GenerateBudget;
+    options.fastSolve = FastSolve;
+    options.fuzzRounds = FuzzRounds;
+    options.pruneInfeasible = PruneInfeasible;
+    options.jobParallel = FunctionJobs;
+    // 所有中间文件都生成在本次运行独占的工作区中, 运行结束时删除
+    Workspace workspace(WorkspaceDir);
+    if(!workspace.valid()){
         return 1;
     }
+    workspace.setKeep(KeepWorkspace);
+    if(!ServeSocket.empty()){
+        ReuseServer server(options, workspace, ServeSocket);
+        return server.run();
+    }
+    if(!ManifestFile.empty()){
+        return runManifest(options, workspace);
+    }
+    if(multiple){
+        return runFunctions(options, workspace);
+    }
     oldSrcFile = OldSrcFile;
     newSrcFile = NewSrcFile;
     functionName = FunctionName;
     testJsonFile = TestJsonFile;
     std::cout << "oldSrcFile: " << oldSrcFile << ", newSrcFile: " << newSrcFile << ", functionName: " << functionName << ", testJsonFile: " << testJsonFile << "\n";
-    ReuseEngine reuseEngine;
-    reuseEngine.setSrcAndFunction(oldSrcFile, newSrcFile, functionName);
-    if(!CFGoption.empty()){
-        reuseEngine.drawNewCFG();
-    }
-    TestSuite newTestSuite;
-    auto info =  reuseEngine.reuseTestSuite(testJsonFile, newTestSuite);
-    std::vector<int> uncoveredPaths;
-    for(int i = 0; i < info.size(); i++){
-        if(info[i] == 0){
-            uncoveredPaths.push_back(i);
-        }
+    ReuseJob job;
+    job.oldSrcFile = oldSrcFile;
+    job.newSrcFile = newSrcFile;
+    job.functionName = functionName;
+    job.testJsonFile = testJsonFile;
+    job.drawCFG = !CFGoption.empty();
+    auto report = runReuseJob(job, options, workspace);
+    if(!report.success){
+        std::cerr << report.message << "\n";
+        return 1;
     }
-    TestGenerator testGenerator(newSrcFile, functionName, uncoveredPaths);
-    testGenerator.run();
-    // 再运行一遍新的测试用例
-    TestSuite newTestSuite2;
-    cleanUselessFiles();
     return 0;
-}
\ No newline at end of file
+}
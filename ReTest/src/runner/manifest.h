@@ -0,0 +1,161 @@
+#ifndef PCTRT_MANIFEST_H
+#define PCTRT_MANIFEST_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <nlohmann/json.hpp>
+
+#include "runner/reusejob.h"
+#include "utils/common.h"
+
+namespace PCTRT
+{
+
+/**
+ * 从一个JSON对象中读取任务: old、new、func和test必须给出, output和cache可以省略。
+ * 相对路径相对于baseDir; output默认为测试套件旁边的<测试套件名>_reused.json,
+ * 没有指定cache并且没有全局的缓存文件时使用测试套件旁边的<测试套件名>_exec_cache.json。
+ * 失败时返回false并在error中给出原因
+ */
+bool parseJob(const nlohmann::json& entry, const std::filesystem::path& baseDir, const RuntimeOptions& options,
+              ReuseJob& job, std::string& error){
+    auto field = [&](const char* key){
+        return entry.is_object() && entry.contains(key) && entry[key].is_string() ? entry[key].get<std::string>() : std::string();
+    };
+    auto resolve = [&](const std::string& file){
+        std::filesystem::path path(file);
+        return (path.is_absolute() ? path : baseDir / path).lexically_normal().string();
+    };
+    if(field("old").empty() || field("new").empty() || field("func").empty() || field("test").empty()){
+        error = "must specify old, new, func and test";
+        return false;
+    }
+    job.oldSrcFile = resolve(field("old"));
+    job.newSrcFile = resolve(field("new"));
+    job.functionName = field("func");
+    job.testJsonFile = resolve(field("test"));
+    if(!field("output").empty()){
+        job.outputFile = resolve(field("output"));
+    }else{
+        job.outputFile = getDirPath(job.testJsonFile) + getBaseName(job.testJsonFile) + "_reused" + suiteExtension(job.testJsonFile);
+    }
+    if(!field("cache").empty()){
+        job.cacheFile = field("cache") == "none" ? "none" : resolve(field("cache"));
+    }else if(options.execCacheFile.empty()){
+        job.cacheFile = getDirPath(job.testJsonFile) + getNakedName(job.testJsonFile) + "_exec_cache.json";
+    }
+    if(!fileExists(job.oldSrcFile) || !fileExists(job.newSrcFile)){
+        error = "source file " + (fileExists(job.oldSrcFile) ? job.newSrcFile : job.oldSrcFile) + " does not exist";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 任务清单: 一次运行中处理的(旧版本源文件, 新版本源文件, 函数, 测试套件)列表, JSON格式
+ *   {"jobs": [{"old": "a/f_old.c", "new": "a/f.c", "func": "f", "test": "a/f_suite.json", "output": "a/f_new.json"}, ...]}
+ * 顶层也可以直接是任务数组。相对路径相对于清单文件所在的目录, 每个任务的字段见parseJob。
+ * 两个任务的输出文件相同时拒绝整个清单。
+ */
+bool loadManifest(const std::string& manifestFile, const RuntimeOptions& options, std::vector<ReuseJob>& jobs){
+    std::ifstream fin(manifestFile);
+    if(!fin){
+        std::cout << "Cannot open manifest file: " << manifestFile << std::endl;
+        return false;
+    }
+    auto j = nlohmann::json::parse(fin, nullptr, false);
+    if(j.is_object() && j.contains("jobs")){
+        j = j["jobs"];
+    }
+    if(j.is_discarded() || !j.is_array()){
+        std::cout << "Manifest file " << manifestFile << " is not a list of jobs" << std::endl;
+        return false;
+    }
+    std::filesystem::path base = std::filesystem::path(manifestFile).parent_path();
+    std::map<std::string, size_t> outputs;
+    for(size_t i = 0; i < j.size(); ++i){
+        ReuseJob job;
+        std::string error;
+        if(!parseJob(j[i], base, options, job, error)){
+            std::cout << "Job " << i << " in manifest: " << error << std::endl;
+            return false;
+        }
+        if(!fileExists(job.testJsonFile)){
+            std::cout << "Job " << i << ": test json file " << job.testJsonFile << " does not exist, all paths will be generated" << std::endl;
+        }
+        if(auto [it, inserted] = outputs.emplace(job.outputFile, i); !inserted){
+            std::cout << "Jobs " << it->second << " and " << i << " both write " << job.outputFile << ", please specify output" << std::endl;
+            return false;
+        }
+        jobs.push_back(std::move(job));
+    }
+    return true;
+}
+
+// 一个任务的结果, 用于汇总报告和常驻进程的应答
+nlohmann::ordered_json reportToJson(const ReuseJob& job, const ReuseJobReport& report){
+    nlohmann::ordered_json item;
+    item["old"] = job.oldSrcFile;
+    item["new"] = job.newSrcFile;
+    item["func"] = job.functionName;
+    item["test"] = job.testJsonFile;
+    item["output"] = report.outputFile;
+    item["success"] = report.success;
+    if(!report.success){
+        item["message"] = report.message;
+    }
+    item["totalPaths"] = report.totalPaths;
+    item["coveredPaths"] = report.coveredPaths;
+    item["infeasiblePaths"] = report.infeasiblePaths;
+    item["reusedTestCases"] = report.reusedTestCases;
+    item["generatedTestCases"] = report.generatedTestCases;
+    item["seconds"] = report.seconds;
+    return item;
+}
+
+// 输出所有任务的汇总报告
+bool dumpJobReports(const std::vector<ReuseJob>& jobs, const std::vector<ReuseJobReport>& reports, const std::string& reportFile){
+    nlohmann::ordered_json j;
+    nlohmann::ordered_json items = nlohmann::ordered_json::array();
+    size_t failed = 0, totalPaths = 0, coveredPaths = 0, infeasiblePaths = 0, reused = 0, generated = 0;
+    for(size_t i = 0; i < jobs.size() && i < reports.size(); ++i){
+        const auto& job = jobs[i];
+        const auto& report = reports[i];
+        if(!report.success){
+            failed++;
+        }
+        items.push_back(reportToJson(job, report));
+        totalPaths += report.totalPaths;
+        coveredPaths += report.coveredPaths;
+        infeasiblePaths += report.infeasiblePaths;
+        reused += report.reusedTestCases;
+        generated += report.generatedTestCases;
+    }
+    j["summary"] = {
+        {"jobs", jobs.size()},
+        {"failed", failed},
+        {"totalPaths", totalPaths},
+        {"coveredPaths", coveredPaths},
+        {"infeasiblePaths", infeasiblePaths},
+        {"reusedTestCases", reused},
+        {"generatedTestCases", generated},
+    };
+    j["jobs"] = std::move(items);
+    std::ofstream fout(reportFile);
+    if(!fout){
+        std::cout << "Cannot write report file: " << reportFile << std::endl;
+        return false;
+    }
+    fout << j.dump(2);
+    fout.close();
+    std::cout << "Report of " << jobs.size() << " jobs written to " << reportFile << std::endl;
+    return true;
+}
+
+} // namespace PCTRT
+
+#endif //PCTRT_MANIFEST_H
@@ -0,0 +1,340 @@
+#ifndef PCTRT_REUSEJOB_H
+#define PCTRT_REUSEJOB_H
+
+#include <map>
+#include <set>
+#include <condition_variable>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fnmatch.h>
+#include <exception>
+#include <iostream>
+
+#include "dynamic/reuseengine.h"
+#include "dynamic/execcache.h"
+#include "generate/testgenerator.h"
+#include "generate/drivergenerator.h"
+#include "utils/modulecache.h"
+#include "utils/workspace.h"
+#include "utils/common.h"
+#include "utils/config.h"
+
+namespace PCTRT
+{
+
+// 一个函数的测试复用任务
+struct ReuseJob {
+    std::string oldSrcFile;
+    std::string newSrcFile;
+    std::string functionName;
+    std::string testJsonFile;
+    std::string outputFile;     // 新版本测试套件的输出文件, 为空时使用ReuseEngine的默认文件名
+    std::string cacheFile;      // 执行结果缓存文件, 为空时使用RuntimeOptions中的设置; 缓存文件相同的任务共用一个缓存
+    bool drawCFG {false};       // 是否画出新版本的CFG
+};
+
+// 一个任务的结果
+struct ReuseJobReport {
+    std::string functionName;
+    std::string outputFile;
+    bool success {false};
+    std::string message;        // 失败的原因
+    size_t totalPaths {0};
+    size_t coveredPaths {0};
+    size_t infeasiblePaths {0};
+    size_t reusedTestCases {0};
+    size_t generatedTestCases {0};
+    double seconds {0};
+};
+
+// 把源文件复制到工作区, 副本中的main函数改名, 使驱动可以定义自己的main
+std::string stageSource(Workspace& workspace, const std::string& srcFile){
+    return workspace.stage(srcFile, [](const std::string& copy){
+        DriverGenerator(copy).modifyMainFunction(copy);
+    });
+}
+
+/**
+ * 执行一个任务: 复用旧版本的测试用例, 为仍未覆盖的路径生成测试用例, 输出新版本的测试套件。
+ * 源文件的副本和所有中间文件都在工作区中, 输出的测试套件和执行结果缓存仍按原路径命名。
+ * 任务的所有步骤都在调用线程中完成, 不同线程中的任务可以同时执行。
+ */
+ReuseJobReport runReuseJob(const ReuseJob& job, const RuntimeOptions& options, Workspace& workspace,
+                           std::shared_ptr<ExecutionCache> cache = nullptr){
+    ReuseJobReport report;
+    report.functionName = job.functionName;
+    auto start = std::chrono::steady_clock::now();
+    std::string oldSrcFile = stageSource(workspace, job.oldSrcFile);
+    std::string newSrcFile = stageSource(workspace, job.newSrcFile);
+    if(oldSrcFile.empty() || newSrcFile.empty()){
+        report.message = "cannot copy source files to workspace";
+        return report;
+    }
+    ReuseEngine reuseEngine;
+    reuseEngine.setOptions(options);
+    if(cache){
+        reuseEngine.setCache(std::move(cache));
+    }
+    if(!job.outputFile.empty()){
+        reuseEngine.setOutputFile(job.outputFile);
+    }
+    if(!reuseEngine.setSrcAndFunction(oldSrcFile, newSrcFile, job.functionName)){
+        report.message = "cannot build the CFG of function " + job.functionName;
+        return report;
+    }
+    if(job.drawCFG){
+        reuseEngine.drawNewCFG();
+    }
+    TestSuite newTestSuite;
+    auto info = reuseEngine.reuseTestSuite(job.testJsonFile, newTestSuite);
+    std::vector<int> uncoveredPaths;
+    for(int i = 0; i < info.size(); i++){
+        if(info[i] == 0){
+            uncoveredPaths.push_back(i);
+        }
+    }
+    report.reusedTestCases = newTestSuite.testCases.size();
+    newTestSuite.setSrcFile(job.newSrcFile);
+    TestGenerator testGenerator(newSrcFile, job.functionName, uncoveredPaths, options);
+    testGenerator.setTester(reuseEngine.getTester());
+    testGenerator.setSeedSuite(&newTestSuite);
+    TestSuite generatedSuite;
+    testGenerator.run(generatedSuite);
+    report.infeasiblePaths = generatedSuite.getInfeasiblePaths().size();
+    report.generatedTestCases = generatedSuite.testCases.size();
+    // 生成的测试用例追加到复用的测试套件中, 一起输出
+    reuseEngine.addGeneratedTestCases(newTestSuite, std::move(generatedSuite));
+    reuseEngine.dumpNewTestSuite(newTestSuite);
+    std::vector<bool> covered(info.size(), false);
+    for(const auto& tc : newTestSuite.testCases){
+        if(tc.pathId >= 0 && tc.pathId < covered.size()){
+            covered[tc.pathId] = true;
+        }
+    }
+    report.totalPaths = info.size();
+    report.coveredPaths = std::count(covered.begin(), covered.end(), true);
+    report.outputFile = reuseEngine.getOutputFile();
+    report.success = true;
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+/**
+ * CacheRegistry: 按缓存文件共用ExecutionCache
+ * 缓存文件相同的任务得到同一个缓存对象; 文件名为空或"none"时返回nullptr, 由ReuseEngine按测试套件文件创建自己的缓存
+ */
+class CacheRegistry {
+private:
+    std::mutex mtx;
+    std::map<std::string, std::shared_ptr<ExecutionCache>> caches;
+
+public:
+    std::shared_ptr<ExecutionCache> get(const std::string& file){
+        if(file.empty() || file == "none"){
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        auto& cache = caches[file];
+        if(!cache){
+            cache = std::make_shared<ExecutionCache>(file);
+        }
+        return cache;
+    }
+
+    void saveAll(){
+        std::lock_guard<std::mutex> lock(mtx);
+        for(auto& [file, cache] : caches){
+            cache->save();
+        }
+    }
+};
+
+// 多个任务同时执行时, 没有指定测试进程和KLEE进程并发数的情况下按工作线程数平分
+RuntimeOptions splitParallelism(const RuntimeOptions& options, size_t workers){
+    RuntimeOptions jobOptions = options;
+    if(workers > 1){
+        if(jobOptions.execParallel == 0){
+            jobOptions.execParallel = std::max<size_t>(1, ProcessPool::defaultParallelism() / workers);
+        }
+        if(jobOptions.kleeParallel == 0){
+            jobOptions.kleeParallel = std::max<size_t>(1, KleeScheduler::defaultParallelism() / workers);
+        }
+    }
+    return jobOptions;
+}
+
+// 任务生成的文件以源文件(副本所在的目录)和函数名区分, 键相同的两个任务不能同时执行
+std::vector<std::string> artifactKeys(const ReuseJob& job){
+    return {job.oldSrcFile + "\n" + job.functionName, job.newSrcFile + "\n" + job.functionName};
+}
+
+/**
+ * JobRunner: 用固定数量的工作线程执行一组任务
+ * 每个工作线程取出下一个可以开始的任务并完整地执行它。同一个源文件在工作区中只有一个副本,
+ * 驱动、插桩后的IR和KLEE的输出在副本旁边按函数名命名, 源文件和函数都相同的两个任务不会同时执行。
+ * 缓存文件相同的任务共用同一个ExecutionCache, 所有任务结束后每个缓存保存一次。
+ * 多个任务同时执行时, 没有指定测试进程和KLEE进程并发数的情况下按工作线程数平分, 总的进程数仍与单个任务时相当。
+ */
+class JobRunner {
+private:
+    RuntimeOptions options;
+    Workspace& workspace;
+    size_t parallel;
+    std::mutex mtx;
+    std::condition_variable released;
+    CacheRegistry caches;
+
+public:
+    JobRunner(const RuntimeOptions& opts, Workspace& ws)
+        : options(opts)
+        , workspace(ws)
+        , parallel(opts.jobParallel > 0 ? opts.jobParallel : ProcessPool::defaultParallelism())
+        {}
+
+    std::vector<ReuseJobReport> run(const std::vector<ReuseJob>& jobs){
+        std::vector<ReuseJobReport> reports(jobs.size());
+        size_t workers = std::max<size_t>(1, std::min(parallel, jobs.size()));
+        RuntimeOptions jobOptions = splitParallelism(options, workers);
+        std::vector<bool> started(jobs.size(), false);
+        std::set<std::string> busy;     // 正在执行的任务占用的文件名前缀
+        auto worker = [&](){
+            while(true){
+                size_t i = jobs.size();
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    while(true){
+                        bool remaining = false;
+                        for(size_t k = 0; k < jobs.size() && i == jobs.size(); ++k){
+                            if(started[k]){
+                                continue;
+                            }
+                            remaining = true;
+                            auto keys = artifactKeys(jobs[k]);
+                            if(std::none_of(keys.begin(), keys.end(), [&](const std::string& key){ return busy.count(key) > 0; })){
+                                i = k;
+                            }
+                        }
+                        if(i < jobs.size() || !remaining){
+                            break;
+                        }
+                        released.wait(lock);
+                    }
+                    if(i == jobs.size()){
+                        return;
+                    }
+                    started[i] = true;
+                    for(const auto& key : artifactKeys(jobs[i])){
+                        busy.insert(key);
+                    }
+                }
+                std::cout << "Start job " << i << ": function " << jobs[i].functionName << std::endl;
+                try{
+                    reports[i] = runReuseJob(jobs[i], jobOptions, workspace, getCache(jobs[i]));
+                }catch(const std::exception& e){
+                    reports[i].functionName = jobs[i].functionName;
+                    reports[i].message = e.what();
+                }
+                std::cout << "Finish job " << i << ": function " << jobs[i].functionName
+                          << (reports[i].success ? "" : " failed: " + reports[i].message) << std::endl;
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    for(const auto& key : artifactKeys(jobs[i])){
+                        busy.erase(key);
+                    }
+                }
+                released.notify_all();
+            }
+        };
+        std::vector<std::thread> threads;
+        for(size_t t = 1; t < workers; ++t){
+            threads.emplace_back(worker);
+        }
+        worker();
+        for(auto& thread : threads){
+            thread.join();
+        }
+        caches.saveAll();
+        return reports;
+    }
+
+private:
+    std::shared_ptr<ExecutionCache> getCache(const ReuseJob& job){
+        return caches.get(job.cacheFile.empty() ? options.execCacheFile : job.cacheFile);
+    }
+};
+
+// 打印每个任务的结果, 返回失败的任务数
+size_t printJobReports(const std::vector<ReuseJobReport>& reports){
+    size_t failed = 0;
+    for(const auto& report : reports){
+        if(!report.success){
+            std::cout << report.functionName << ": failed, " << report.message << "\n";
+            failed++;
+            continue;
+        }
+        std::cout << report.functionName << ": " << report.coveredPaths << "/" << report.totalPaths << " paths covered, "
+                  << report.infeasiblePaths << " infeasible, " << report.reusedTestCases << " reused and "
+                  << report.generatedTestCases << " generated test cases, " << report.seconds << "s -> " << report.outputFile << "\n";
+    }
+    return failed;
+}
+
+/**
+ * 列出新版本源文件中与patterns(逗号分隔的函数名或通配符)匹配的函数。
+ * 只保留在两个版本中都有定义、并且能生成驱动的函数, 其余的函数打印原因后跳过
+ */
+std::vector<std::string> listFunctions(const std::string& oldSrcFile, const std::string& newSrcFile, const std::string& patterns){
+    std::vector<std::string> globs;
+    for(size_t begin = 0; begin <= patterns.size();){
+        size_t end = std::min(patterns.find(',', begin), patterns.size());
+        if(end > begin){
+            globs.push_back(patterns.substr(begin, end - begin));
+        }
+        begin = end + 1;
+    }
+    std::string oldIrFile = getDirPath(oldSrcFile) + getBaseName(oldSrcFile) + ".ll";
+    std::string newIrFile = getDirPath(newSrcFile) + getBaseName(newSrcFile) + ".ll";
+    if(!ModuleCache::compile(oldSrcFile, oldIrFile) || !ModuleCache::compile(newSrcFile, newIrFile)){
+        std::cout << "Compile source files to llvm IR failed" << std::endl;
+        return {};
+    }
+    llvm::Module* oldModule = ModuleCache::get(oldIrFile);
+    llvm::Module* newModule = ModuleCache::get(newIrFile);
+    if(!oldModule || !newModule){
+        return {};
+    }
+    DriverGenerator oldGenerator(oldSrcFile), newGenerator(newSrcFile);
+    std::vector<std::string> functions;
+    for(const auto& function : *newModule){
+        std::string name = function.getName().str();
+        if(function.isDeclaration() || function.isIntrinsic() || name == "main" || name == "__main__"){
+            continue;
+        }
+        bool matched = false;
+        for(const auto& glob : globs){
+            matched = matched || fnmatch(glob.c_str(), name.c_str(), 0) == 0;
+        }
+        if(!matched){
+            continue;
+        }
+        const llvm::Function* oldFunction = oldModule->getFunction(name);
+        if(oldFunction == nullptr || oldFunction->isDeclaration()){
+            std::cout << "Skip function " << name << ": not defined in the old version" << std::endl;
+        }else if(!oldGenerator.isSupported(name) || !newGenerator.isSupported(name)){
+            std::cout << "Skip function " << name << ": cannot generate driver for it" << std::endl;
+        }else{
+            functions.push_back(name);
+        }
+    }
+    return functions;
+}
+
+} // namespace PCTRT
+
+#endif //PCTRT_REUSEJOB_H
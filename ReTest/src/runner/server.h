@@ -0,0 +1,371 @@
+#ifndef PCTRT_SERVER_H
+#define PCTRT_SERVER_H
+
+#include <set>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <exception>
+#include <filesystem>
+#include <condition_variable>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <nlohmann/json.hpp>
+
+#include "runner/reusejob.h"
+#include "runner/manifest.h"
+#include "utils/workspace.h"
+#include "utils/config.h"
+
+namespace PCTRT
+{
+
+/**
+ * ReuseServer: 监听Unix domain socket的常驻进程
+ * 每个请求是一行JSON, 字段与任务清单中的任务相同(old、new、func、test, 可选output和cache),
+ * 相对路径相对于常驻进程启动时的工作目录; 应答也是一行JSON, 内容与汇总报告中的一个任务相同。
+ * 另外支持{"cmd": "ping"}和{"cmd": "shutdown"}。一个连接中可以依次发送多个请求。
+ *
+ * 固定数量的工作线程处理连接, 每个线程的ModuleCache和CFGCache在请求之间保留,
+ * 路径相似度、编译结果和执行结果缓存在所有线程之间共用; 源文件没有修改时后续请求跳过解析、构建CFG、
+ * 计算相似度、生成驱动和插桩编译, 只有执行结果缓存未命中的测试用例才真正执行。
+ * 每个请求结束后保存它使用的执行结果缓存。源文件和函数都相同的两个请求依次执行。
+ * 连接空闲超过SERVER_IDLE_TIMEOUT_MS后被关闭, 空闲的客户端不会一直占用工作线程;
+ * 停止时所有正在处理的连接都被shutdown, 阻塞在读写上的工作线程随之返回。
+ */
+class ReuseServer {
+private:
+    RuntimeOptions options;
+    Workspace& workspace;
+    std::string socketPath;
+    std::filesystem::path baseDir;  // 请求中相对路径的基准目录
+    size_t workers;
+
+    CacheRegistry caches;
+    std::mutex mtx;
+    std::condition_variable pendingReady;
+    std::condition_variable released;
+    std::deque<int> pending;        // 等待处理的连接
+    std::set<int> active;           // 正在由工作线程处理的连接
+    std::set<std::string> busy;     // 正在执行的请求占用的文件名前缀
+    bool stopping {false};
+
+    inline static int wakeFd {-1};  // 信号处理函数和shutdown请求通过这个管道唤醒accept循环
+
+    static void onSignal(int){
+        char c = 1;
+        [[maybe_unused]] auto n = write(wakeFd, &c, 1);
+    }
+
+public:
+    ReuseServer(const RuntimeOptions& opts, Workspace& ws, std::string socket)
+        : options(opts)
+        , workspace(ws)
+        , socketPath(std::move(socket))
+        , workers(opts.jobParallel > 0 ? opts.jobParallel : ProcessPool::defaultParallelism())
+        {
+        std::error_code ec;
+        baseDir = std::filesystem::current_path(ec);
+        options = splitParallelism(opts, workers);
+    }
+
+    // 一直运行到收到SIGINT、SIGTERM或shutdown请求, 返回进程的退出码
+    int run(){
+        int listenFd = listenOn(socketPath);
+        if(listenFd < 0){
+            return 1;
+        }
+        int pipeFds[2];
+        if(pipe2(pipeFds, O_CLOEXEC | O_NONBLOCK) != 0){
+            std::cout << "Cannot create pipe: " << strerror(errno) << std::endl;
+            close(listenFd);
+            return 1;
+        }
+        wakeFd = pipeFds[1];
+        struct sigaction action {};
+        action.sa_handler = onSignal;
+        sigemptyset(&action.sa_mask);
+        struct sigaction oldInt {}, oldTerm {};
+        sigaction(SIGINT, &action, &oldInt);
+        sigaction(SIGTERM, &action, &oldTerm);
+
+        std::vector<std::thread> threads;
+        for(size_t i = 0; i < workers; ++i){
+            threads.emplace_back([this](){ worker(); });
+        }
+        std::cout << "Listening on " << socketPath << " with " << workers << " workers" << std::endl;
+        while(true){
+            pollfd fds[2] = {{listenFd, POLLIN, 0}, {pipeFds[0], POLLIN, 0}};
+            if(poll(fds, 2, -1) < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                std::cout << "Poll failed: " << strerror(errno) << std::endl;
+                break;
+            }
+            if(fds[1].revents != 0){
+                break;
+            }
+            if(fds[0].revents & POLLIN){
+                int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                if(fd < 0){
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(mtx);
+                pending.push_back(fd);
+                pendingReady.notify_one();
+            }
+        }
+        std::cout << "Shutting down" << std::endl;
+        close(listenFd);
+        unlink(socketPath.c_str());
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+            for(int fd : pending){
+                close(fd);
+            }
+            pending.clear();
+            for(int fd : active){
+                shutdown(fd, SHUT_RDWR);
+            }
+        }
+        pendingReady.notify_all();
+        for(auto& thread : threads){
+            thread.join();
+        }
+        caches.saveAll();
+        sigaction(SIGINT, &oldInt, nullptr);
+        sigaction(SIGTERM, &oldTerm, nullptr);
+        wakeFd = -1;
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        return 0;
+    }
+
+private:
+    // socket文件已经存在时, 能连接说明另一个常驻进程正在使用它, 否则是上次遗留的文件
+    static int listenOn(const std::string& path){
+        sockaddr_un addr {};
+        if(path.size() >= sizeof(addr.sun_path)){
+            std::cout << "Socket path is too long: " << path << std::endl;
+            return -1;
+        }
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd < 0){
+            std::cout << "Cannot create socket: " << strerror(errno) << std::endl;
+            return -1;
+        }
+        if(fileExists(path)){
+            if(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0){
+                std::cout << "Another server is listening on " << path << std::endl;
+                close(fd);
+                return -1;
+            }
+            unlink(path.c_str());
+        }
+        if(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0){
+            std::cout << "Cannot listen on " << path << ": " << strerror(errno) << std::endl;
+            close(fd);
+            return -1;
+        }
+        // 只有启动常驻进程的用户可以提交请求
+        chmod(path.c_str(), S_IRUSR | S_IWUSR);
+        return fd;
+    }
+
+    void worker(){
+        while(true){
+            int fd;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                pendingReady.wait(lock, [this](){ return stopping || !pending.empty(); });
+                if(pending.empty()){
+                    return;
+                }
+                fd = pending.front();
+                pending.pop_front();
+                active.insert(fd);
+            }
+            serveConnection(fd);
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                active.erase(fd);
+            }
+            close(fd);
+        }
+    }
+
+    void serveConnection(int fd){
+        std::string buffer;
+        char chunk[4096];
+        while(true){
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if(stopping){
+                    return;
+                }
+            }
+            size_t newline = buffer.find('\n');
+            if(newline == std::string::npos){
+                if(buffer.size() > SERVER_MAX_REQUEST_BYTES){
+                    return;
+                }
+                pollfd pfd {fd, POLLIN, 0};
+                int ready = poll(&pfd, 1, SERVER_IDLE_TIMEOUT_MS);
+                if(ready < 0 && errno == EINTR){
+                    continue;
+                }
+                if(ready <= 0){
+                    return;
+                }
+                ssize_t n = read(fd, chunk, sizeof(chunk));
+                if(n < 0 && errno == EINTR){
+                    continue;
+                }
+                if(n <= 0){
+                    return;
+                }
+                buffer.append(chunk, n);
+                continue;
+            }
+            std::string line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            if(line.find_first_not_of(" \t\r") == std::string::npos){
+                continue;
+            }
+            bool shutdown = false;
+            std::string response = handleRequest(line, shutdown) + "\n";
+            if(!sendAll(fd, response)){
+                return;
+            }
+            if(shutdown){
+                onSignal(0);
+                return;
+            }
+        }
+    }
+
+    std::string handleRequest(const std::string& line, bool& shutdown){
+        auto request = nlohmann::json::parse(line, nullptr, false);
+        if(request.is_discarded() || !request.is_object()){
+            return nlohmann::ordered_json{{"success", false}, {"message", "request is not a json object"}}.dump();
+        }
+        std::string cmd = request.contains("cmd") && request["cmd"].is_string() ? request["cmd"].get<std::string>() : "reuse";
+        if(cmd == "ping"){
+            return nlohmann::ordered_json{{"success", true}, {"message", "pong"}}.dump();
+        }
+        if(cmd == "shutdown"){
+            shutdown = true;
+            return nlohmann::ordered_json{{"success", true}, {"message", "shutting down"}}.dump();
+        }
+        if(cmd != "reuse"){
+            return nlohmann::ordered_json{{"success", false}, {"message", "unknown command " + cmd}}.dump();
+        }
+        ReuseJob job;
+        std::string error;
+        if(!parseJob(request, baseDir, options, job, error)){
+            return nlohmann::ordered_json{{"success", false}, {"message", error}}.dump();
+        }
+        auto keys = artifactKeys(job);
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            released.wait(lock, [&](){
+                return std::none_of(keys.begin(), keys.end(), [&](const std::string& key){ return busy.count(key) > 0; });
+            });
+            busy.insert(keys.begin(), keys.end());
+        }
+        ReuseJobReport report;
+        auto cache = caches.get(job.cacheFile.empty() ? options.execCacheFile : job.cacheFile);
+        try{
+            report = runReuseJob(job, options, workspace, cache);
+        }catch(const std::exception& e){
+            report.functionName = job.functionName;
+            report.message = e.what();
+        }
+        if(cache){
+            cache->save();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for(const auto& key : keys){
+                busy.erase(key);
+            }
+        }
+        released.notify_all();
+        std::cout << "Request for function " << job.functionName << (report.success ? " done" : " failed: " + report.message)
+                  << ", " << report.seconds << "s" << std::endl;
+        return reportToJson(job, report).dump();
+    }
+
+    static bool sendAll(int fd, const std::string& data){
+        size_t sent = 0;
+        while(sent < data.size()){
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if(n < 0 && errno == EINTR){
+                continue;
+            }
+            if(n <= 0){
+                return false;
+            }
+            sent += n;
+        }
+        return true;
+    }
+
+public:
+    // 客户端: 发送一行请求并等待一行应答, 连接失败时返回false
+    static bool sendRequest(const std::string& path, const std::string& request, std::string& response){
+        sockaddr_un addr {};
+        if(path.size() >= sizeof(addr.sun_path)){
+            std::cout << "Socket path is too long: " << path << std::endl;
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0){
+            std::cout << "Cannot connect to " << path << ": " << strerror(errno) << std::endl;
+            if(fd >= 0){
+                close(fd);
+            }
+            return false;
+        }
+        bool ok = sendAll(fd, request + "\n");
+        response.clear();
+        char chunk[4096];
+        while(ok && response.find('\n') == std::string::npos){
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if(n < 0 && errno == EINTR){
+                continue;
+            }
+            if(n <= 0){
+                break;
+            }
+            response.append(chunk, n);
+        }
+        close(fd);
+        if(auto newline = response.find('\n'); newline != std::string::npos){
+            response.resize(newline);
+            return true;
+        }
+        std::cout << "Server closed the connection without a response" << std::endl;
+        return false;
+    }
+};
+
+} // namespace PCTRT
+
+#endif //PCTRT_SERVER_H
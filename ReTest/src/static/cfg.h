@@ -7,6 +7,10 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Dominators.h>
 #include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Support/Allocator.h>
+#include <llvm/Support/StringSaver.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
 #include <memory>
 #include <vector>
 #include <map>
@@ -65,29 +69,28 @@ NLOHMANN_JSON_SERIALIZE_ENUM( NODE_TYPE, {
 
 /**
  * Node: 对llvm::BasicBlock进行一层封装，使之能持有额外的信息并可持久化
+ * 后继、opcode序列和源代码都存放在所属CFG的arena中, Node本身只持有它们的视图;
+ * 打印出的IR文本只在输出JSON时按需生成。
  */
 class Node
 {
 private:
-    static int count_;
+    static thread_local int count_;     // 编号计数器按线程独立, 多个线程可以同时构建各自的CFG
     int id;
     NODE_TYPE node_type;
-    std::vector<int> successors;
-    std::vector<std::string> ops;
-    std::string instructions;
-    std::string src;
+    const llvm::BasicBlock* block {nullptr};
+    llvm::ArrayRef<int> successors;
+    llvm::ArrayRef<unsigned> ops;       // 每条指令的opcode
+    llvm::StringRef src;
     int selectNum {0};  // 0为默认，1为true，2为false，其他按分支顺序
 public:
-    Node() : id(count_++), node_type(NODE_TYPE::NODE_NORMAL) {};
-    ~Node() = default;
-
-    explicit Node(const llvm::BasicBlock* block, NODE_TYPE nodeType = NODE_TYPE::NODE_NORMAL){
-        id = count_++;
-        node_type = nodeType;
-        printBasicBlockToNodeStr(block, instructions);
-        getInstructionsType(block);
+    Node(const llvm::BasicBlock* block, llvm::BumpPtrAllocator& arena, NODE_TYPE nodeType = NODE_TYPE::NODE_NORMAL)
+        : id(count_++), node_type(nodeType), block(block) {
+        getInstructionsType(arena);
     }
 
+    ~Node() = default;
+
     void setType(NODE_TYPE nodeType){
         node_type = nodeType;
     }
@@ -108,18 +111,28 @@ public:
         return id;
     }
 
-    std::vector<int>& getSuccessors(){
+    void setSuccessors(llvm::ArrayRef<int> succ){
+        successors = succ;
+    }
+
+    [[nodiscard]] llvm::ArrayRef<int> getSuccessors() const {
         return successors;
     }
 
-    void setSrcInfo(const std::string& srcStr){
+    void setSrcInfo(llvm::StringRef srcStr){
         src = srcStr;
     }
 
-    [[nodiscard]] const std::string& getSrcInfo() const {
+    [[nodiscard]] llvm::StringRef getSrcInfo() const {
         return src;
     }
 
+    [[nodiscard]] std::string getInstructions() const {
+        std::string str;
+        printBasicBlockToNodeStr(block, str);
+        return str;
+    }
+
     static void printBasicBlockToNodeStr(const llvm::BasicBlock* block, std::string& str){
         llvm::raw_string_ostream rso(str);
         for(auto& instruction : *block){
@@ -127,13 +140,20 @@ public:
         }
     }
 
-    void getInstructionsType(const llvm::BasicBlock* block){
+    void getInstructionsType(llvm::BumpPtrAllocator& arena){
+        size_t num = block->size();
+        if(num == 0){
+            return;
+        }
+        auto* buffer = arena.Allocate<unsigned>(num);
+        size_t i = 0;
         for(auto& instruction : *block){
-            ops.emplace_back(instruction.getOpcodeName());
+            buffer[i++] = instruction.getOpcode();
         }
+        ops = llvm::ArrayRef<unsigned>(buffer, num);
     }
 
-    [[nodiscard]] const std::vector<std::string>& getOps() const {
+    [[nodiscard]] llvm::ArrayRef<unsigned> getOps() const {
         return ops;
     }
 
@@ -141,31 +161,55 @@ public:
         count_ = 0;
     }
 
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE(Node, id, node_type, selectNum, instructions, ops, src, successors)
+    friend void to_json(json& j, const Node& node);
 }; // class Node
 
-int Node::count_ = 0;
+thread_local int Node::count_ = 0;
+
+void to_json(json& j, const Node& node){
+    std::vector<std::string> opNames;
+    opNames.reserve(node.ops.size());
+    for(auto op : node.ops){
+        opNames.emplace_back(llvm::Instruction::getOpcodeName(op));
+    }
+    j = json{
+        {"id", node.id},
+        {"node_type", node.node_type},
+        {"selectNum", node.selectNum},
+        {"instructions", node.getInstructions()},
+        {"ops", opNames},
+        {"src", node.src.str()},
+        {"successors", std::vector<int>(node.successors.begin(), node.successors.end())}
+    };
+}
 
 /**
  * Path: CFG中的静态路径
+ * 节点编号序列和节点掩码都存放在所属CFG的arena中, 掩码按位存储, 每个uint64_t存放64个节点
  */
 class Path
 {
 
 private:
-    static int count_;
+    static thread_local int count_;
     int id_;
-    std::vector<const Node*> nodes;
+    const Node* nodeBase;               // CFG的节点数组, 节点编号即下标
+    llvm::ArrayRef<int> nodeIds;
+    const uint64_t* maskWords;
     int total_nodes;
 
 public:
-    explicit Path(int total_nodes, const std::vector<const Node*>& nodes) :
-        id_(count_++), total_nodes(total_nodes), mask(std::make_unique<pathMask>(total_nodes)) {
-            this->nodes = nodes;
-            for(auto node : nodes){
-                int node_id = node->getId();
+    static size_t maskWordCount(int numNodes){
+        return (static_cast<size_t>(numNodes) + 63) / 64;
+    }
+
+    // maskBuffer至少有maskWordCount(total_nodes)个元素, 由调用者分配
+    Path(const Node* nodeBase, llvm::ArrayRef<int> nodeIds, uint64_t* maskBuffer, int total_nodes) :
+        id_(count_++), nodeBase(nodeBase), nodeIds(nodeIds), maskWords(maskBuffer), total_nodes(total_nodes) {
+            std::fill(maskBuffer, maskBuffer + maskWordCount(total_nodes), 0);
+            for(auto node_id : nodeIds){
                 PCTRT_ASSERT(node_id >= 0 && node_id < total_nodes, "Node id is out of range.");
-                mask->setBit(node_id);
+                maskBuffer[node_id / 64] |= uint64_t(1) << (node_id % 64);
             }
     }
 
@@ -174,23 +218,50 @@ public:
     }
 
     [[nodiscard]] size_t size() const {
-        return nodes.size();
+        return nodeIds.size();
     }
 
     [[nodiscard]] const Node* getNode(int idx) const {
-        PCTRT_ASSERT(idx >= 0 && idx < nodes.size(), "Index is out of range.");
-        return nodes[idx];
+        PCTRT_ASSERT(idx >= 0 && idx < nodeIds.size(), "Index is out of range.");
+        return &nodeBase[nodeIds[idx]];
+    }
+
+    [[nodiscard]] llvm::ArrayRef<int> getNodeIds() const {
+        return nodeIds;
+    }
+
+    [[nodiscard]] bool hasNode(int node_id) const {
+        return node_id >= 0 && node_id < total_nodes && (maskWords[node_id / 64] >> (node_id % 64) & 1);
+    }
+
+    // 当前路径经过other经过的所有节点
+    [[nodiscard]] bool covers(const Path& other) const {
+        if(total_nodes != other.total_nodes){
+            return false;
+        }
+        for(size_t i = 0; i < maskWordCount(total_nodes); ++i){
+            if(other.maskWords[i] & ~maskWords[i]){
+                return false;
+            }
+        }
+        return true;
     }
 
     [[nodiscard]] std::string to_string() const {
-        return mask->to_string();
+        std::string ret(total_nodes, '0');
+        for(int i = 0; i < total_nodes; ++i){
+            if(hasNode(i)){
+                ret[i] = '1';
+            }
+        }
+        return ret;
     }
 
     [[nodiscard]] std::string to_string_with_nodes() const {
         std::string ret;
-        for(int i = 0; i < nodes.size(); ++i){
-            ret += std::to_string(nodes[i]->getId());
-            if(i != nodes.size() - 1){
+        for(int i = 0; i < nodeIds.size(); ++i){
+            ret += std::to_string(nodeIds[i]);
+            if(i != nodeIds.size() - 1){
                 ret += " -> ";
             }
         }
@@ -198,11 +269,7 @@ public:
     }
 
     [[nodiscard]] std::vector<int> to_vector_of_nodes() const {
-        std::vector<int> ret;
-        for(auto node : nodes){
-            ret.push_back(node->getId());
-        }
-        return ret;
+        return {nodeIds.begin(), nodeIds.end()};
     }
 
     ~Path()= default;
@@ -212,88 +279,86 @@ public:
     }
 
     friend void to_json(json& j, const Path& path);
-    friend void from_json(const json& j, Path& path);
 
+    // 运行时得到的路径掩码字符串, 每个字符对应一个节点
     struct pathMask {
         int numNodes;
-        std::unique_ptr<bool[]> nodeMask;
-        explicit pathMask(int num) : numNodes(num) {
-            nodeMask = std::make_unique<bool[]>(numNodes);
-            for(int i = 0; i < numNodes; ++i){
-                nodeMask[i] = false;
-            }
-        }
+        std::vector<uint64_t> words;
+        explicit pathMask(int num) : numNodes(num), words(maskWordCount(num), 0) {}
 
-        explicit pathMask(const std::string& str) : numNodes(static_cast<int>(str.size())) {
-            nodeMask = std::make_unique<bool[]>(numNodes);
+        explicit pathMask(const std::string& str) : pathMask(static_cast<int>(str.size())) {
             for(int i = 0; i < numNodes; ++i){
-                nodeMask[i] = str[i] == '1';
+                if(str[i] == '1'){
+                    setBit(i);
+                }
             }
         }
 
-        void setBit(int index) const {
+        void setBit(int index){
             PCTRT_ASSERT(index >= 0 && index < numNodes, "Index is out of range.");
-            nodeMask[index] = true;
+            words[index / 64] |= uint64_t(1) << (index % 64);
         }
 
         [[nodiscard]] bool isCover(const pathMask& other) const {
-//            PCTRT_ASSERT(numNodes == other.numNodes, "The number of nodes is not equal.");
             if(numNodes != other.numNodes){
                 return false;
             }
-            for(int i = 0; i < numNodes; ++i){
-                if(other.nodeMask[i] && !nodeMask[i]){
+            for(size_t i = 0; i < words.size(); ++i){
+                if(other.words[i] & ~words[i]){
                     return false;
                 }
             }
             return true;
         }
 
-        void clearBits() const {
-            for(int i = 0; i < numNodes; ++i){
-                nodeMask[i] = false;
+        [[nodiscard]] bool isCover(const Path& path) const {
+            if(numNodes != path.total_nodes){
+                return false;
+            }
+            for(size_t i = 0; i < words.size(); ++i){
+                if(path.maskWords[i] & ~words[i]){
+                    return false;
+                }
             }
+            return true;
+        }
+
+        void clearBits(){
+            std::fill(words.begin(), words.end(), 0);
         }
 
         [[nodiscard]] std::string to_string() const{
             std::string ret(numNodes, '0');
             for (int i = 0; i < numNodes; ++i) {
-                ret[i] = nodeMask[i] ? '1' : '0';
+                ret[i] = (words[i / 64] >> (i % 64) & 1) ? '1' : '0';
             }
             return ret;
         }
     };
-
-    std::shared_ptr<pathMask> mask {nullptr};
 };
 
-int Path::count_ = 0;
+thread_local int Path::count_ = 0;
 
 void to_json(json& j, const Path& path){
     j = json{
         {"id", path.id_},
-        {"mask", path.mask->to_string()},
+        {"mask", path.to_string()},
         {"nodesStr", path.to_string_with_nodes()}
     };
 }
 
-void from_json(const json& j, Path& path){
-    j.at("id").get_to(path.id_);
-    path.mask = std::make_shared<Path::pathMask>(j.at("mask").get<std::string>());
-}
-
 /**
  * CFG: 对llvm::Function进行的简单封装
  */
 class CFG
 {
 private:
-    static int count_;
+    static thread_local int count_;
     int id;
     size_t size{};
-    std::vector<Node> nodes;
+    llvm::BumpPtrAllocator arena;           // 节点的后继、opcode、源代码以及路径的节点序列和掩码, 随CFG一起释放
+    std::vector<Node> nodes;                // 节点之间的边保存在每个节点的后继中
     std::unordered_map<const llvm::BasicBlock*, int> node_map;
-    std::vector<std::vector<int>> edges;    // 节点之间的边
     std::vector<Path> paths;                // 静态路径
 
     // 静态分析相关
@@ -322,6 +387,10 @@ public:
         return size;
     }
 
+    [[nodiscard]] bool hasLoops() const {
+        return loopInfo && !loopInfo->empty();
+    }
+
     std::vector<Path>& getPaths(){
         return paths;
     }
@@ -350,9 +419,9 @@ public:
         return paths[pathId].to_string_with_nodes();
     }
 
-    std::vector<int> getBlockSuccessors(int blockId){
+    [[nodiscard]] llvm::ArrayRef<int> getBlockSuccessors(int blockId) const {
         PCTRT_ASSERT(blockId >= 0 && blockId < size, "Block id is out of range.");
-        return edges[blockId];
+        return nodes[blockId].getSuccessors();
     }
 
     void initGraphFromFunction(llvm::Function* function){
@@ -360,14 +429,13 @@ public:
         func = function;
         size = function->size();
         nodes.reserve(size);
-        edges.resize(size);
         DT = std::make_unique<llvm::DominatorTree>(*function);
         loopInfo = std::make_unique<llvm::LoopInfo>();
         loopInfo->analyze(*DT);
 
         int bbId = 0;
         for (auto& block : *function) {
-            nodes.emplace_back(&block);
+            nodes.emplace_back(&block, arena);
             node_map[&block] = bbId;
             PCTRT_ASSERT(bbId == nodes.back().getId(), "Node id doesn't match!");
             bbId++;
@@ -391,10 +459,11 @@ public:
     void buildGraph() {
         for (auto& [block, node_id] : node_map) {
             auto& node = nodes[node_id];
-            auto& successors = node.getSuccessors();
+            llvm::SmallVector<int, 4> successors;
             for(auto it = succ_begin(block); it != succ_end(block); ++it){
                 successors.push_back(node_map[*it]);
             }
+            node.setSuccessors(copyToArena(llvm::ArrayRef<int>(successors)));
             if(successors.empty()){
                 node.setType(NODE_TYPE::NODE_EXIT);
             }else if (successors.size() > 1) {
@@ -408,10 +477,20 @@ public:
                     nodes[node_map[block->getTerminator()->getSuccessor(i)]].setSelectNum(i + 1);
                 }
             }
-            edges[node_id] = node.getSuccessors();
         }
     }
 
+    // 把data复制到arena中, 返回的视图在CFG析构之前一直有效
+    template<typename T>
+    llvm::ArrayRef<T> copyToArena(llvm::ArrayRef<T> data){
+        if(data.empty()){
+            return {};
+        }
+        T* buffer = arena.Allocate<T>(data.size());
+        std::copy(data.begin(), data.end(), buffer);
+        return {buffer, data.size()};
+    }
+
     void handleLoopsInFunction(llvm::Loop* loop){
         if(loop == nullptr){
             return;
@@ -431,13 +510,11 @@ public:
         }else{
             idPaths = dfsWithLoops();
         }
+        paths.reserve(idPaths.size());
+        size_t maskWords = Path::maskWordCount(static_cast<int>(size));
         for(const auto& idPath : idPaths) {
-            std::vector<const Node*> nodePath;
-            nodePath.reserve(idPath.size());
-            for(auto node_id : idPath){
-                nodePath.push_back(&nodes[node_id]);
-            }
-            paths.emplace_back(size, nodePath);
+            auto* mask = arena.Allocate<uint64_t>(maskWords);
+            paths.emplace_back(nodes.data(), copyToArena(llvm::ArrayRef<int>(idPath)), mask, static_cast<int>(size));
             pathIdMap[paths.back().to_string()] = paths.back().getId();
         }
     }
@@ -451,11 +528,11 @@ public:
             std::vector<int> currentPath = stack.top();
             stack.pop();
             int currentNode = currentPath.back();
-            for (int neighbor : edges[currentNode]) {
+            for (int neighbor : nodes[currentNode].getSuccessors()) {
                 std::vector<int> newPath = currentPath;
                 newPath.push_back(neighbor);
                 // If the neighbor is the destination, add the path to the result
-                if (edges[neighbor].empty()) {
+                if (nodes[neighbor].getSuccessors().empty()) {
                     allPaths.push_back(newPath);
                 } else {
                     stack.push(newPath);
@@ -576,6 +653,7 @@ public:
     }
 
     void addSrcInfoToNodes(){
+        llvm::StringSaver saver(arena);
         for(auto& node : nodes){
             std::string nodeSrcStr;
             auto& nodeLocs = srcLocs[node.getId()];
@@ -585,7 +663,7 @@ public:
             for(const auto& loc : nodeLocs){
                 nodeSrcStr += getSrcWithLoc(loc);
             }
-            node.setSrcInfo(nodeSrcStr);
+            node.setSrcInfo(saver.save(nodeSrcStr));
             // std::cout << "node_id: " << node.getId() << " src: " << nodeSrcStr << "\n";
         }
     }
@@ -631,14 +709,18 @@ public:
         std::vector<int> ret;
         Path::pathMask mask(pathMask);
         for(auto& path : paths){
-            Path::pathMask pm(path.to_string());
-            if(mask.isCover(pm)){
+            if(mask.isCover(path)){
                 ret.push_back(path.getId());
             }
         }
         return std::move(ret);
     }
 
+    // 清除matchBestPathId记录的执行次数, 同一个CFG用于新的测试套件之前调用
+    void resetMatchState(){
+        pathTestCntMap.clear();
+    }
+
     int matchBestPathId(const std::string& pathMask) {
         int pathId = matchPathId(pathMask);
         if(pathId != INVALID_PATH_ID && pathTestCntMap.count(pathId) == 0){
@@ -669,11 +751,11 @@ public:
         dotString += "\tlabel=\"CFG for " + func->getName().str() + " function\";\n";
         for(auto& node : nodes){
             dotString += "\t" + std::to_string(node.getId());
-            dotString +=" [label=\"" + std::to_string(node.getId()) + "\\n" + node.getSrcInfo() + "\"];\n";
+            dotString +=" [label=\"" + std::to_string(node.getId()) + "\\n" + node.getSrcInfo().str() + "\"];\n";
         }
 
         for(int i = 0; i < size; ++i){
-            for(auto& next : edges[i]){
+            for(auto next : nodes[i].getSuccessors()){
                 dotString += "\t" + std::to_string(i) + " -> " + std::to_string(next) + ";\n";
             }
         }
@@ -682,32 +764,29 @@ public:
     }
 
     friend void to_json(json& j, const CFG& cfg);
-    friend void from_json(const json& j, CFG& cfg);
 }; // class CFG
 
-int CFG::count_ = 0;
+thread_local int CFG::count_ = 0;
 
 /**
  * Json序列化: CFG
+ * 节点引用llvm::Function中的基本块, 只能从IR构建, 不支持从JSON反序列化
  */
 void to_json(json& j, const CFG& cfg){
+    std::vector<std::vector<int>> edges;
+    edges.reserve(cfg.nodes.size());
+    for(const auto& node : cfg.nodes){
+        edges.emplace_back(node.getSuccessors().begin(), node.getSuccessors().end());
+    }
     j = json{
         {"id", cfg.id},
         {"size", cfg.size},
         {"nodes", cfg.nodes},
-        {"edges", cfg.edges},
+        {"edges", edges},
         {"paths", cfg.paths}
     };
 }
 
-void from_json(const json &j, CFG &cfg) {
-    j.at("id").get_to(cfg.id);
-    j.at("size").get_to(cfg.size);
-    j.at("nodes").get_to(cfg.nodes);
-    j.at("edges").get_to(cfg.edges);
-//    j.at("paths").get_to(cfg.paths);
-}
-
 
 } //namespace PCTRT
 
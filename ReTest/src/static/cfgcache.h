@@ -0,0 +1,56 @@
+#ifndef PCTRT_CFGCACHE_H
+#define PCTRT_CFGCACHE_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <iostream>
+
+#include "static/cfg.h"
+#include "utils/modulecache.h"
+
+namespace PCTRT
+{
+
+/**
+ * CFGCache: 按线程缓存构建好的CFG
+ * CFG引用ModuleCache中当前线程解析的llvm::Function, 因此和Module一样按线程缓存,
+ * 键为(IR文件, 函数名), IR文件被改写后重新构建。常驻进程中同一个函数的后续请求直接使用缓存的CFG,
+ * 使用者在匹配路径之前调用CFG::resetMatchState清除上一次请求留下的动态信息。
+ */
+class CFGCache {
+private:
+    struct CachedCFG {
+        long long stamp {0};
+        std::shared_ptr<CFG> cfg;
+    };
+
+    static std::map<std::string, CachedCFG>& threadCFGs(){
+        thread_local std::map<std::string, CachedCFG> cfgs;
+        return cfgs;
+    }
+
+public:
+    // 当前线程中irFile里函数funcName的CFG, srcFile用于读取源代码信息; 找不到函数时返回nullptr
+    static std::shared_ptr<CFG> get(const std::string& irFile, const std::string& srcFile, const std::string& funcName){
+        llvm::Module* module = ModuleCache::get(irFile);
+        if(!module || !module->getFunction(funcName)){
+            std::cout << "Cannot find function " << funcName << " in " << irFile << std::endl;
+            return nullptr;
+        }
+        long long stamp = ModuleCache::modifyTime(irFile);
+        auto& cached = threadCFGs()[irFile + "\n" + funcName];
+        if(cached.cfg && cached.stamp == stamp){
+            return cached.cfg;
+        }
+        cached.cfg = std::make_shared<CFG>();
+        cached.cfg->initGraphFromFunction(module->getFunction(funcName));
+        cached.cfg->getInfoFromSrcFile(srcFile);
+        cached.stamp = stamp;
+        return cached.cfg;
+    }
+};
+
+} // namespace PCTRT
+
+#endif //PCTRT_CFGCACHE_H
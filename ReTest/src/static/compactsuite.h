@@ -0,0 +1,548 @@
+#ifndef PCTRT_COMPACTSUITE_H
+#define PCTRT_COMPACTSUITE_H
+
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "static/testcase.h"
+#include "utils/common.h"
+
+namespace PCTRT
+{
+
+#define PCTS_VERSION 2
+#define PCTS_MIN_VERSION 1  // 能读取的最早版本, 版本1的元数据中没有srcHash
+
+const std::string PCTS_EXTENSION = ".pcts";
+
+/**
+ * 紧凑的二进制测试套件格式(.pcts), 可以直接mmap后按需读取, 与JSON格式可以无损互相转换。
+ * 整数均为本机字节序, 各段按8字节对齐:
+ *   文件头: "PCTS" | u32 版本 | u64 测试用例数 | u64 字符串数 | 字符串表、元数据、用例索引、路径索引、用例数据各段的偏移
+ *   字符串表: u64 偏移[字符串数 + 1] | 字符串内容; 名称、类型、描述等重复出现的字符串只存一次, 以u32编号引用
+ *   元数据: u32 源文件 | u32 函数名 | u32 描述 | u8 是否执行过 | f64 覆盖率 | u32 不可行路径数 | i32 路径... | u32 srcHash(版本2起)
+ *   用例索引: u64 每个用例在用例数据段中的偏移
+ *   路径索引: 按(路径, 用例编号)排序的(i32, u32)对, 二分查找得到覆盖某条路径的所有用例
+ *   用例: i32 路径 | u32 描述 | u32 status | u32 result | u32 输入数 | u32 输出数 | 输入... | 输出...
+ *   输入/输出变量: u32 名称 | u32 类型 | u8 编码 | 数据
+ * 变量的数据按内容选择编码: 十进制整数存为i64, 形如"[1,2,3]"的整数数组存为u32 元素个数 + i32元素,
+ * 其余的存为字符串编号; 只有能原样还原为同一个字符串时才使用整数编码, 保证转换是无损的。
+ */
+class CompactSuite {
+public:
+    enum PayloadTag : uint8_t {
+        PAYLOAD_STRING = 0,
+        PAYLOAD_INT = 1,
+        PAYLOAD_INT_ARRAY = 2,
+    };
+
+    struct PathEntry {
+        int32_t pathId;
+        uint32_t caseIndex;
+    };
+
+private:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t caseCount;
+        uint64_t stringCount;
+        uint64_t stringsOffset;
+        uint64_t metaOffset;
+        uint64_t caseIndexOffset;
+        uint64_t pathIndexOffset;
+        uint64_t casesOffset;
+    };
+
+    const char* data {nullptr};
+    size_t size {0};
+    const Header* header {nullptr};
+    const uint64_t* stringOffsets {nullptr};
+    const char* stringBlob {nullptr};
+    size_t stringBlobSize {0};
+    const uint64_t* caseOffsets {nullptr};
+    const PathEntry* pathIndex {nullptr};
+
+public:
+    CompactSuite() = default;
+
+    ~CompactSuite(){
+        close();
+    }
+
+    CompactSuite(const CompactSuite&) = delete;
+    CompactSuite& operator=(const CompactSuite&) = delete;
+
+    // 文件扩展名为.pcts时使用二进制格式
+    static bool isCompactFile(const std::string& file){
+        return file.size() >= PCTS_EXTENSION.size() && file.compare(file.size() - PCTS_EXTENSION.size(), PCTS_EXTENSION.size(), PCTS_EXTENSION) == 0;
+    }
+
+    bool open(const std::string& file){
+        close();
+        int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0){
+            std::cout << "Cannot open test suite file: " << file << std::endl;
+            return false;
+        }
+        struct stat st {};
+        if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)){
+            ::close(fd);
+            std::cout << "Unrecognized test suite file: " << file << std::endl;
+            return false;
+        }
+        void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(mapped == MAP_FAILED){
+            std::cout << "Cannot map test suite file " << file << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        data = static_cast<const char*>(mapped);
+        size = st.st_size;
+        if(!validate()){
+            std::cout << "Unrecognized test suite file: " << file << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close(){
+        if(data != nullptr){
+            munmap(const_cast<char*>(data), size);
+        }
+        data = nullptr;
+        size = 0;
+        header = nullptr;
+    }
+
+    [[nodiscard]] size_t caseCount() const {
+        return header ? header->caseCount : 0;
+    }
+
+    [[nodiscard]] std::string_view getString(uint32_t id) const {
+        if(id >= header->stringCount){
+            return {};
+        }
+        return {stringBlob + stringOffsets[id], stringOffsets[id + 1] - stringOffsets[id]};
+    }
+
+    [[nodiscard]] int getPathId(size_t idx) const {
+        PCTRT_ASSERT(idx < caseCount(), "TestCase index out of range.");
+        int32_t pathId;
+        std::memcpy(&pathId, data + header->casesOffset + caseOffsets[idx], sizeof(pathId));
+        return pathId;
+    }
+
+    // 覆盖路径pathId的用例, 按用例编号排序
+    [[nodiscard]] std::pair<const PathEntry*, const PathEntry*> casesOnPath(int pathId) const {
+        const PathEntry* end = pathIndex + caseCount();
+        auto range = std::equal_range(pathIndex, end, PathEntry{pathId, 0}, [](const PathEntry& a, const PathEntry& b){
+            return a.pathId < b.pathId;
+        });
+        return {range.first, range.second};
+    }
+
+    // 只解码第idx个用例
+    bool getTestCase(size_t idx, TestCase& tc) const {
+        if(idx >= caseCount()){
+            return false;
+        }
+        Reader reader{data + header->casesOffset + caseOffsets[idx], data + size};
+        int32_t pathId;
+        uint32_t description, status, result, inputCount, outputCount;
+        if(!reader.read(pathId) || !reader.read(description) || !reader.read(status) || !reader.read(result)
+           || !reader.read(inputCount) || !reader.read(outputCount) || !reader.holds(inputCount + uint64_t(outputCount), 9)){
+            return false;
+        }
+        tc = TestCase();
+        tc.pathId = pathId;
+        tc.description = getString(description);
+        tc.status = getString(status);
+        tc.result = getString(result);
+        tc.inputs.resize(inputCount);
+        for(auto& input : tc.inputs){
+            if(!readVar(reader, input.name, input.type, input.data)){
+                return false;
+            }
+        }
+        tc.outputs.resize(outputCount);
+        for(auto& output : tc.outputs){
+            if(!readVar(reader, output.name, output.type, output.expectation)){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 测试套件的元数据, 不解码测试用例
+    bool getMeta(TestSuite& ts) const {
+        Reader reader{data + header->metaOffset, data + size};
+        uint32_t srcFile, funcName, description, infeasibleCount;
+        uint8_t executed;
+        double coverage;
+        if(!reader.read(srcFile) || !reader.read(funcName) || !reader.read(description) || !reader.read(executed)
+           || !reader.read(coverage) || !reader.read(infeasibleCount) || !reader.holds(infeasibleCount, sizeof(int32_t))){
+            return false;
+        }
+        std::vector<int> infeasiblePaths(infeasibleCount);
+        for(auto& path : infeasiblePaths){
+            int32_t value;
+            if(!reader.read(value)){
+                return false;
+            }
+            path = value;
+        }
+        // 版本1的元数据到不可行路径为止, 之后是对齐填充, 不能当作srcHash读取
+        uint32_t srcHash = UINT32_MAX;
+        if(header->version >= 2 && !reader.read(srcHash)){
+            return false;
+        }
+        ts = TestSuite();
+        ts.setSrcFile(std::string(getString(srcFile)));
+        ts.setFuncName(std::string(getString(funcName)));
+        ts.setDescription(std::string(getString(description)));
+        ts.setExecuted(executed != 0);
+        ts.setCoverage(coverage);
+        ts.setInfeasiblePaths(std::move(infeasiblePaths));
+        ts.setSrcHash(std::string(getString(srcHash)));
+        return true;
+    }
+
+    // 第idx个用例是否异常结束, 只读取status
+    [[nodiscard]] bool isAbnormal(size_t idx) const {
+        PCTRT_ASSERT(idx < caseCount(), "TestCase index out of range.");
+        uint32_t status;
+        std::memcpy(&status, data + header->casesOffset + caseOffsets[idx] + sizeof(int32_t) + sizeof(uint32_t), sizeof(status));
+        return !getString(status).empty();
+    }
+
+    bool toTestSuite(TestSuite& ts) const {
+        if(!getMeta(ts)){
+            return false;
+        }
+        ts.testCases.resize(caseCount());
+        for(size_t i = 0; i < caseCount(); ++i){
+            if(!getTestCase(i, ts.testCases[i])){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool write(const TestSuite& ts, const std::string& file){
+        Writer writer;
+        return writer.build(ts) && writeFileIfChanged(file, writer.content());
+    }
+
+private:
+    struct Reader {
+        const char* pos;
+        const char* end;
+
+        // 剩余的数据至少能容纳count个width字节的元素, 用于在分配内存前检查损坏的文件
+        [[nodiscard]] bool holds(uint64_t count, size_t width) const {
+            return count <= static_cast<size_t>(end - pos) / width;
+        }
+
+        template<typename T>
+        bool read(T& value){
+            if(static_cast<size_t>(end - pos) < sizeof(T)){
+                return false;
+            }
+            std::memcpy(&value, pos, sizeof(T));
+            pos += sizeof(T);
+            return true;
+        }
+    };
+
+    bool readVar(Reader& reader, std::string& name, std::string& type, std::string& value) const {
+        uint32_t nameId, typeId;
+        uint8_t tag;
+        if(!reader.read(nameId) || !reader.read(typeId) || !reader.read(tag)){
+            return false;
+        }
+        name = getString(nameId);
+        type = getString(typeId);
+        if(tag == PAYLOAD_STRING){
+            uint32_t id;
+            if(!reader.read(id)){
+                return false;
+            }
+            value = getString(id);
+        }else if(tag == PAYLOAD_INT){
+            int64_t number;
+            if(!reader.read(number)){
+                return false;
+            }
+            value = std::to_string(number);
+        }else if(tag == PAYLOAD_INT_ARRAY){
+            uint32_t count;
+            if(!reader.read(count) || !reader.holds(count, sizeof(int32_t))){
+                return false;
+            }
+            value = "[";
+            for(uint32_t i = 0; i < count; ++i){
+                int32_t element;
+                if(!reader.read(element)){
+                    return false;
+                }
+                value += (i == 0 ? "" : ",") + std::to_string(element);
+            }
+            value += "]";
+        }else{
+            return false;
+        }
+        return true;
+    }
+
+    // 检查各段的偏移都在文件范围内, 之后的访问只需检查用例数据
+    bool validate(){
+        header = reinterpret_cast<const Header*>(data);
+        if(std::memcmp(header->magic, "PCTS", 4) != 0 || header->version < PCTS_MIN_VERSION || header->version > PCTS_VERSION
+           || header->stringCount >= size || header->caseCount >= size){
+            return false;
+        }
+        auto fits = [&](uint64_t offset, uint64_t count, uint64_t width){
+            return offset <= size && count <= (size - offset) / width;
+        };
+        if(!fits(header->stringsOffset, header->stringCount + 1, sizeof(uint64_t))
+           || !fits(header->caseIndexOffset, header->caseCount, sizeof(uint64_t))
+           || !fits(header->pathIndexOffset, header->caseCount, sizeof(PathEntry))
+           || header->metaOffset > size || header->casesOffset > size){
+            return false;
+        }
+        stringOffsets = reinterpret_cast<const uint64_t*>(data + header->stringsOffset);
+        stringBlob = data + header->stringsOffset + (header->stringCount + 1) * sizeof(uint64_t);
+        stringBlobSize = size - (stringBlob - data);
+        for(uint64_t i = 0; i < header->stringCount; ++i){
+            if(stringOffsets[i] > stringOffsets[i + 1] || stringOffsets[i + 1] > stringBlobSize){
+                return false;
+            }
+        }
+        caseOffsets = reinterpret_cast<const uint64_t*>(data + header->caseIndexOffset);
+        pathIndex = reinterpret_cast<const PathEntry*>(data + header->pathIndexOffset);
+        // 每个用例至少包含路径、描述、status、result和变量个数, getPathId和isAbnormal直接读取这部分
+        const uint64_t caseHeaderSize = sizeof(int32_t) + 5 * sizeof(uint32_t);
+        for(uint64_t i = 0; i < header->caseCount; ++i){
+            if(size - header->casesOffset < caseHeaderSize || caseOffsets[i] > size - header->casesOffset - caseHeaderSize){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    class Writer {
+    private:
+        std::vector<std::string_view> strings;
+        std::unordered_map<std::string_view, uint32_t> stringIds;
+        std::string cases;
+        std::string meta;
+        std::vector<uint64_t> caseOffsets;
+        std::vector<PathEntry> pathIndex;
+        std::string output;
+
+        template<typename T>
+        static void append(std::string& buffer, T value){
+            buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        static void align(std::string& buffer){
+            buffer.resize((buffer.size() + 7) / 8 * 8, '\0');
+        }
+
+        // 字符串由调用者的TestSuite持有, 写完之前不会失效
+        uint32_t intern(const std::string& str){
+            auto [it, inserted] = stringIds.emplace(str, static_cast<uint32_t>(strings.size()));
+            if(inserted){
+                strings.push_back(str);
+            }
+            return it->second;
+        }
+
+        static bool parseInt(const std::string& str, int64_t& value){
+            if(str.empty() || str.size() > 20){
+                return false;
+            }
+            char* end = nullptr;
+            errno = 0;
+            long long number = std::strtoll(str.c_str(), &end, 10);
+            if(errno != 0 || *end != '\0' || std::to_string(number) != str){
+                return false;
+            }
+            value = number;
+            return true;
+        }
+
+        static bool parseIntArray(const std::string& str, std::vector<int32_t>& values){
+            if(str.size() < 2 || str.front() != '[' || str.back() != ']'){
+                return false;
+            }
+            values.clear();
+            std::string canonical = "[";
+            size_t begin = 1;
+            while(begin < str.size() - 1){
+                size_t end = std::min(str.find(',', begin), str.size() - 1);
+                int64_t value;
+                if(!parseInt(str.substr(begin, end - begin), value) || value < INT32_MIN || value > INT32_MAX){
+                    return false;
+                }
+                canonical += (values.empty() ? "" : ",") + std::to_string(value);
+                values.push_back(static_cast<int32_t>(value));
+                begin = end + 1;
+            }
+            return canonical + "]" == str;
+        }
+
+        void appendVar(const std::string& name, const std::string& type, const std::string& value){
+            append(cases, intern(name));
+            append(cases, intern(type));
+            int64_t number;
+            std::vector<int32_t> array;
+            if(parseInt(value, number)){
+                append(cases, PAYLOAD_INT);
+                append(cases, number);
+            }else if(value.size() > 2 && parseIntArray(value, array)){
+                append(cases, PAYLOAD_INT_ARRAY);
+                append(cases, static_cast<uint32_t>(array.size()));
+                cases.append(reinterpret_cast<const char*>(array.data()), array.size() * sizeof(int32_t));
+            }else{
+                append(cases, PAYLOAD_STRING);
+                append(cases, intern(value));
+            }
+        }
+
+    public:
+        bool build(const TestSuite& ts){
+            const auto& testCases = ts.testCases;
+            if(testCases.size() > UINT32_MAX){
+                return false;
+            }
+            std::string srcFile = ts.getSrcFile(), funcName = ts.getFuncName(), description = ts.getDescription();
+            append(meta, intern(srcFile));
+            append(meta, intern(funcName));
+            append(meta, intern(description));
+            append(meta, static_cast<uint8_t>(ts.isExecuted()));
+            append(meta, ts.getPathCoverage());
+            append(meta, static_cast<uint32_t>(ts.getInfeasiblePaths().size()));
+            for(int path : ts.getInfeasiblePaths()){
+                append(meta, static_cast<int32_t>(path));
+            }
+            std::string srcHash = ts.getSrcHash();
+            append(meta, intern(srcHash));
+            for(size_t i = 0; i < testCases.size(); ++i){
+                const auto& tc = testCases[i];
+                caseOffsets.push_back(cases.size());
+                pathIndex.push_back({tc.pathId, static_cast<uint32_t>(i)});
+                append(cases, static_cast<int32_t>(tc.pathId));
+                append(cases, intern(tc.description));
+                append(cases, intern(tc.status));
+                append(cases, intern(tc.result));
+                append(cases, static_cast<uint32_t>(tc.inputs.size()));
+                append(cases, static_cast<uint32_t>(tc.outputs.size()));
+                for(const auto& input : tc.inputs){
+                    appendVar(input.name, input.type, input.data);
+                }
+                for(const auto& output : tc.outputs){
+                    appendVar(output.name, output.type, output.expectation);
+                }
+            }
+            std::sort(pathIndex.begin(), pathIndex.end(), [](const PathEntry& a, const PathEntry& b){
+                return a.pathId != b.pathId ? a.pathId < b.pathId : a.caseIndex < b.caseIndex;
+            });
+            // 按文件中的顺序拼接各段, 先占位文件头, 最后回填各段的偏移
+            Header header {};
+            std::memcpy(header.magic, "PCTS", 4);
+            header.version = PCTS_VERSION;
+            header.caseCount = testCases.size();
+            header.stringCount = strings.size();
+            output.assign(sizeof(Header), '\0');
+            header.stringsOffset = output.size();
+            uint64_t offset = 0;
+            append(output, offset);
+            for(const auto& str : strings){
+                offset += str.size();
+                append(output, offset);
+            }
+            for(const auto& str : strings){
+                output.append(str.data(), str.size());
+            }
+            align(output);
+            header.metaOffset = output.size();
+            output += meta;
+            align(output);
+            header.caseIndexOffset = output.size();
+            output.append(reinterpret_cast<const char*>(caseOffsets.data()), caseOffsets.size() * sizeof(uint64_t));
+            header.pathIndexOffset = output.size();
+            output.append(reinterpret_cast<const char*>(pathIndex.data()), pathIndex.size() * sizeof(PathEntry));
+            align(output);
+            header.casesOffset = output.size();
+            output += cases;
+            std::memcpy(output.data(), &header, sizeof(Header));
+            return true;
+        }
+
+        [[nodiscard]] const std::string& content() const {
+            return output;
+        }
+    };
+};
+
+// 与testFile格式相同的测试套件文件的扩展名, 用于生成输出文件名
+std::string suiteExtension(const std::string& testFile){
+    return CompactSuite::isCompactFile(testFile) ? PCTS_EXTENSION : ".json";
+}
+
+// 按扩展名读取测试套件, .pcts为二进制格式, 其它为JSON
+bool loadTestSuite(const std::string& file, TestSuite& ts){
+    if(!CompactSuite::isCompactFile(file)){
+        if(!fileExists(file)){
+            std::cout << "File " << file << " does not exist." << std::endl;
+            return false;
+        }
+        ts = getTestSuiteFromFile(file.c_str());
+        return true;
+    }
+    CompactSuite suite;
+    if(!suite.open(file) || !suite.toTestSuite(ts)){
+        std::cout << "Cannot load test suite file: " << file << std::endl;
+        ts = TestSuite();
+        return false;
+    }
+    return true;
+}
+
+TestSuite loadTestSuite(const std::string& file){
+    TestSuite ts;
+    loadTestSuite(file, ts);
+    return ts;
+}
+
+// 按扩展名输出测试套件
+bool dumpTestSuite(const TestSuite& ts, const std::string& file){
+    if(!CompactSuite::isCompactFile(file)){
+        dumpTestSuiteToFile(ts, file);
+        return true;
+    }
+    if(!CompactSuite::write(ts, file)){
+        std::cout << "Cannot write test suite file: " << file << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace PCTRT
+
+#endif //PCTRT_COMPACTSUITE_H
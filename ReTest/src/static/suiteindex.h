@@ -0,0 +1,255 @@
+#ifndef PCTRT_SUITEINDEX_H
+#define PCTRT_SUITEINDEX_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <nlohmann/json.hpp>
+
+#include "static/testcase.h"
+#include "static/compactsuite.h"
+#include "utils/common.h"
+
+namespace PCTRT
+{
+
+/**
+ * SuiteIndex: 只记录测试套件中每个测试用例的pathId、是否异常结束以及它在文件中的位置
+ * JSON文件通过nlohmann的SAX接口流式读取, 不构建DOM, 也不创建TestCase; .pcts文件直接使用其中的用例索引。
+ * 需要某个测试用例的完整内容时再按记录的位置读取并解码这一个用例,
+ * 内存占用与实际用到的测试用例数成正比, 与历史测试套件的大小无关。
+ */
+class SuiteIndex {
+public:
+    struct CaseRef {
+        int pathId {INVALID_PATH_ID};
+        bool abnormal {false};
+        uint64_t begin {0};     // JSON: 用例对象在文件中的字节范围; .pcts: 不使用
+        uint64_t end {0};
+    };
+
+private:
+    std::string file;
+    TestSuite meta;                 // 测试套件的元数据, 不含测试用例
+    std::vector<CaseRef> cases;
+    std::unique_ptr<CompactSuite> compact;
+    std::ifstream fin;
+
+    // 读取JSON时记录已经读到的位置: 解析器每取一个字符就前进一次
+    class TrackingIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = char;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const char*;
+        using reference = const char&;
+
+        TrackingIterator(std::istreambuf_iterator<char> it, uint64_t* position) : it(it), position(position) {}
+
+        char operator*() const {
+            return *it;
+        }
+
+        TrackingIterator& operator++(){
+            ++it;
+            ++*position;
+            return *this;
+        }
+
+        bool operator==(const TrackingIterator& other) const {
+            return it == other.it;
+        }
+
+        bool operator!=(const TrackingIterator& other) const {
+            return it != other.it;
+        }
+
+    private:
+        std::istreambuf_iterator<char> it;
+        uint64_t* position;
+    };
+
+    // 顶层对象的深度为1, testCases数组为2, 每个测试用例对象为3
+    class Handler : public nlohmann::json_sax<nlohmann::json> {
+    public:
+        SuiteIndex& index;
+        const uint64_t& position;
+        int depth {0};
+        std::string topKey;     // 顶层对象中当前的键
+        std::string caseKey;    // 测试用例对象中当前的键
+        bool inCases {false};
+        CaseRef current;
+
+        Handler(SuiteIndex& index, const uint64_t& position) : index(index), position(position) {}
+
+        bool null() override { return true; }
+
+        bool boolean(bool val) override {
+            if(depth == 1 && topKey == "executed"){
+                index.meta.setExecuted(val);
+            }
+            return true;
+        }
+
+        bool number_integer(number_integer_t val) override {
+            if(inCases && depth == 3 && caseKey == "pathId"){
+                current.pathId = static_cast<int>(val);
+            }
+            return true;
+        }
+
+        bool number_unsigned(number_unsigned_t val) override {
+            return number_integer(static_cast<number_integer_t>(val));
+        }
+
+        bool number_float(number_float_t val, const string_t&) override {
+            if(depth == 1 && topKey == "coverage"){
+                index.meta.setCoverage(val);
+            }
+            return true;
+        }
+
+        bool string(string_t& val) override {
+            if(depth == 1){
+                if(topKey == "srcFile"){
+                    index.meta.setSrcFile(val);
+                }else if(topKey == "funcName"){
+                    index.meta.setFuncName(val);
+                }else if(topKey == "description"){
+                    index.meta.setDescription(val);
+                }else if(topKey == "srcHash"){
+                    index.meta.setSrcHash(val);
+                }
+            }else if(inCases && depth == 3 && caseKey == "status"){
+                current.abnormal = !val.empty();
+            }
+            return true;
+        }
+
+        bool binary(binary_t&) override { return true; }
+
+        bool start_object(std::size_t) override {
+            depth++;
+            if(inCases && depth == 3){
+                // '{'已经被读取
+                current = CaseRef();
+                current.begin = position - 1;
+            }
+            return true;
+        }
+
+        bool key(string_t& val) override {
+            if(depth == 1){
+                topKey = val;
+            }else if(inCases && depth == 3){
+                caseKey = val;
+            }
+            return true;
+        }
+
+        bool end_object() override {
+            if(inCases && depth == 3){
+                current.end = position;
+                index.cases.push_back(current);
+            }
+            depth--;
+            return true;
+        }
+
+        bool start_array(std::size_t) override {
+            depth++;
+            if(depth == 2 && topKey == "testCases"){
+                inCases = true;
+            }
+            return true;
+        }
+
+        bool end_array() override {
+            if(inCases && depth == 2){
+                inCases = false;
+            }
+            depth--;
+            return true;
+        }
+
+        bool parse_error(std::size_t pos, const std::string&, const nlohmann::detail::exception& ex) override {
+            std::cout << "Parse test suite failed at byte " << pos << ": " << ex.what() << std::endl;
+            return false;
+        }
+    };
+
+public:
+    bool open(const std::string& suiteFile){
+        file = suiteFile;
+        cases.clear();
+        meta = TestSuite();
+        compact.reset();
+        if(CompactSuite::isCompactFile(file)){
+            compact = std::make_unique<CompactSuite>();
+            if(!compact->open(file) || !compact->getMeta(meta)){
+                return false;
+            }
+            cases.resize(compact->caseCount());
+            for(size_t i = 0; i < cases.size(); ++i){
+                cases[i].pathId = compact->getPathId(i);
+                cases[i].abnormal = compact->isAbnormal(i);
+            }
+            return true;
+        }
+        fin = std::ifstream(file, std::ios::binary);
+        if(!fin){
+            std::cout << "Cannot open test suite file: " << file << std::endl;
+            return false;
+        }
+        uint64_t position = 0;
+        Handler handler(*this, position);
+        TrackingIterator first(std::istreambuf_iterator<char>(fin), &position);
+        TrackingIterator last(std::istreambuf_iterator<char>(), &position);
+        if(!nlohmann::json::sax_parse(first, last, &handler)){
+            cases.clear();
+            return false;
+        }
+        fin.clear();
+        return true;
+    }
+
+    // 元数据(源文件、函数名、是否执行过、srcHash等), 不含测试用例
+    [[nodiscard]] const TestSuite& getMeta() const {
+        return meta;
+    }
+
+    [[nodiscard]] const std::vector<CaseRef>& getCases() const {
+        return cases;
+    }
+
+    // 读取并解码第idx个测试用例
+    bool getTestCase(size_t idx, TestCase& tc){
+        if(idx >= cases.size()){
+            return false;
+        }
+        if(compact){
+            return compact->getTestCase(idx, tc);
+        }
+        const auto& ref = cases[idx];
+        std::string text(ref.end - ref.begin, '\0');
+        fin.seekg(static_cast<std::streamoff>(ref.begin));
+        if(!fin.read(text.data(), static_cast<std::streamsize>(text.size()))){
+            fin.clear();
+            return false;
+        }
+        auto j = nlohmann::json::parse(text, nullptr, false);
+        if(j.is_discarded()){
+            return false;
+        }
+        tc = j.get<TestCase>();
+        return true;
+    }
+};
+
+} // namespace PCTRT
+
+#endif //PCTRT_SUITEINDEX_H
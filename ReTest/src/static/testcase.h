@@ -47,7 +47,8 @@ public:
     std::vector<OutputVar> outputs; // 输出变量
     std::string description;        // 描述
     int pathId {INVALID_PATH_ID};
-    std::string result;
+    std::string result;             // 执行得到的基本块覆盖情况, 异常结束时为已覆盖的部分
+    std::string status;             // 异常结束的原因(超时、超出资源限制、崩溃), 正常结束时为空
 
     TestCase() = default;
     explicit TestCase(std::vector<InputVar> inputs, std::string description)
@@ -71,6 +72,14 @@ public:
         return result;
     }
 
+    void setStatus(std::string st){
+        this->status = std::move(st);
+    }
+
+    [[nodiscard]] bool isAbnormal() const {
+        return !status.empty();
+    }
+
     [[nodiscard]] std::string toString() const {
         std::string str = "[";
         for(int i = 0; i < inputs.size(); ++i){
@@ -93,6 +102,10 @@ void to_json(json& j, const TestCase& tc){
         {"description", tc.description},
         {"pathId", tc.pathId}
     };
+    if(tc.isAbnormal()){
+        j["status"] = tc.status;
+        j["result"] = tc.result;
+    }
 }
 
 void from_json(const json& j, TestCase& tc){
@@ -100,6 +113,10 @@ void from_json(const json& j, TestCase& tc){
     j.at("outputs").get_to(tc.outputs);
     j.at("description").get_to(tc.description);
     j.at("pathId").get_to(tc.pathId);
+    if(j.contains("status")){
+        j.at("status").get_to(tc.status);
+        j.at("result").get_to(tc.result);
+    }
 }
 
 class TestSuite {
@@ -109,6 +126,8 @@ private:
     std::string description;
     bool executed {false};
     double coverage {0.0};
+    std::vector<int> infeasiblePaths;   // 静态分析证明不可能被覆盖的路径
+    std::string srcHash;                // 执行时被测源文件的哈希, 用于判断记录的pathId是否仍然有效
 
 public:
     std::vector<TestCase> testCases;
@@ -117,11 +136,11 @@ public:
 
     explicit TestSuite (
             std::string  srcFile, std::string  funcName,
-            std::string  description, const std::vector<TestCase>& testCases)
+            std::string  description, std::vector<TestCase> testCases)
         : srcFile(std::move(srcFile))
         , funcName(std::move(funcName))
         , description(std::move(description))
-        , testCases(testCases)
+        , testCases(std::move(testCases))
         {}
 
     void setSrcFile(std::string src){
@@ -136,8 +155,8 @@ public:
         this->description = std::move(dsp);
     }
 
-    void setTestCases(const std::vector<TestCase>& tcs){
-        this->testCases = tcs;
+    void setTestCases(std::vector<TestCase> tcs){
+        this->testCases = std::move(tcs);
     }
 
     void setCoverage(double cvg){
@@ -152,6 +171,22 @@ public:
         return executed;
     }
 
+    void setInfeasiblePaths(std::vector<int> paths){
+        this->infeasiblePaths = std::move(paths);
+    }
+
+    [[nodiscard]] const std::vector<int>& getInfeasiblePaths() const {
+        return infeasiblePaths;
+    }
+
+    void setSrcHash(std::string hash){
+        this->srcHash = std::move(hash);
+    }
+
+    [[nodiscard]] const std::string& getSrcHash() const {
+        return srcHash;
+    }
+
     [[nodiscard]] std::string getSrcFile() const {
         return srcFile;
     }
@@ -181,12 +216,16 @@ public:
         testCases.push_back(tc);
     }
 
-    void addTestCaseWithoutExpectation(const TestCase& tc){
-        TestCase newTc = tc;
-        for(auto& output : newTc.outputs){
-            output.expectation = "";
+    // 调用者不再需要的测试用例直接移入, 不复制其中的字符串
+    void addTestCase(TestCase&& tc){
+        testCases.push_back(std::move(tc));
+    }
+
+    void addTestCaseWithoutExpectation(TestCase tc){
+        for(auto& output : tc.outputs){
+            output.expectation.clear();
         }
-        testCases.push_back(newTc);
+        testCases.push_back(std::move(tc));
     }
 
     friend void to_json(json& j, const TestSuite& ts);
@@ -202,6 +241,12 @@ void to_json(json& j, const TestSuite& ts){
         {"coverage", ts.coverage},
         {"testCases", ts.testCases}
     };
+    if(!ts.infeasiblePaths.empty()){
+        j["infeasiblePaths"] = ts.infeasiblePaths;
+    }
+    if(!ts.srcHash.empty()){
+        j["srcHash"] = ts.srcHash;
+    }
 }
 
 void from_json(const json& j, TestSuite& ts){
@@ -210,6 +255,15 @@ void from_json(const json& j, TestSuite& ts){
     j.at("description").get_to(ts.description);
     j.at("coverage").get_to(ts.coverage);
     j.at("testCases").get_to(ts.testCases);
+    if(j.contains("executed")){
+        j.at("executed").get_to(ts.executed);
+    }
+    if(j.contains("infeasiblePaths")){
+        j.at("infeasiblePaths").get_to(ts.infeasiblePaths);
+    }
+    if(j.contains("srcHash")){
+        j.at("srcHash").get_to(ts.srcHash);
+    }
 }
 
 TestSuite getTestSuiteFromFile(const char* filename){
@@ -228,14 +282,16 @@ TestSuite getTestSuiteFromFile(const char* filename){
 void dumpTestSuiteToFile(const TestSuite& ts, const char* filename){
     std::ofstream fout(filename);
     json j = ts;
-    fout << j.dump(4);
+    // KLEE生成的字符数据可能不是合法的UTF-8, 输出时替换掉
+    fout << j.dump(4, ' ', false, json::error_handler_t::replace);
     fout.close();
 }
 
 void dumpTestSuiteToFile(const TestSuite& ts, const std::string& filename){
     std::ofstream fout(filename);
     json j = ts;
-    fout << j.dump(4);
+    // KLEE生成的字符数据可能不是合法的UTF-8, 输出时替换掉
+    fout << j.dump(4, ' ', false, json::error_handler_t::replace);
     fout.close();
 }
 
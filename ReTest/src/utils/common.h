@@ -8,6 +8,10 @@
 #include <fstream>
 #include <iostream>
 #include <utility>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <unistd.h>
 
 #include <llvm/IRReader/IRReader.h>
 #include <llvm/Support/SourceMgr.h>
@@ -30,7 +34,7 @@ namespace PCTRT
 
 #define TEMPLATE_FILE "./utils.h"
 #define TEMPLATE_INCLUDE_STRING "#include <stdio.h>\n#include <stdlib.h>\n#include <fcntl.h>\n#include <unistd.h>\n"
-#define TEMPLATE_MAIN_STRING "int main(int argc, char** argv){\n    int stdout_fd = dup(1);\n    close(1);\n"
+#define TEMPLATE_MAIN_STRING "int main(int argc, char** argv){\n    int stdout_fd = dup(1);\n    close(1);\n    marker_install(stdout_fd);\n"
 #define TEMPLATE_END_STRING "    fflush(stdout);\n    dup2(stdout_fd, 1);\n    return 0;\n}\n"
 #define TEMPLATE_BLANK_STRING "    "
 #define TEMPLATE_PARSER_STRING \
@@ -130,6 +134,277 @@ namespace PCTRT
 "    return ret;\n" \
 "}\n"
 
+// 单用例驱动: 在进程退出(包括被测函数调用exit)或收到崩溃、超时信号时输出__block_marker__,
+// 使被杀死或崩溃的测试用例也能记录已覆盖的基本块
+#define TEMPLATE_MARKER_STRING \
+"#include <signal.h>\n" \
+"#include <string.h>\n" \
+"\n" \
+"extern char __block_marker__[];\n" \
+"\n" \
+"static int marker_fd = -1;\n" \
+"static volatile sig_atomic_t marker_written = 0;\n" \
+"\n" \
+"static void marker_flush(void) {\n" \
+"    if (marker_fd < 0 || marker_written) {\n" \
+"        return;\n" \
+"    }\n" \
+"    marker_written = 1;\n" \
+"    write(marker_fd, __block_marker__, strlen(__block_marker__));\n" \
+"}\n" \
+"\n" \
+"static void marker_on_signal(int sig) {\n" \
+"    marker_flush();\n" \
+"    raise(sig);\n" \
+"}\n" \
+"\n" \
+"static void marker_install(int fd) {\n" \
+"    static char alt_stack[1 << 16];\n" \
+"    stack_t ss;\n" \
+"    memset(&ss, 0, sizeof(ss));\n" \
+"    ss.ss_sp = alt_stack;\n" \
+"    ss.ss_size = sizeof(alt_stack);\n" \
+"    sigaltstack(&ss, NULL);\n" \
+"    struct sigaction sa;\n" \
+"    memset(&sa, 0, sizeof(sa));\n" \
+"    sa.sa_handler = marker_on_signal;\n" \
+"    sa.sa_flags = SA_ONSTACK | SA_RESETHAND;\n" \
+"    int sigs[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, SIGTERM, SIGXCPU};\n" \
+"    for (int i = 0; i < (int)(sizeof(sigs) / sizeof(sigs[0])); i++) {\n" \
+"        sigaction(sigs[i], &sa, NULL);\n" \
+"    }\n" \
+"    marker_fd = fd;\n" \
+"    atexit(marker_flush);\n" \
+"}\n"
+
+// 批量驱动: 从argv[1]指定的文件(mmap)或标准输入中读取长度前缀的二进制测试用例流,
+// 每个测试用例执行前重置__block_marker__, 执行后向标准输出写一条压缩的覆盖记录;
+// 测试用例崩溃、超时或调用exit时, 记录的状态字节为信号值(调用exit时为255), 位图为已覆盖的部分。
+// argv[3]非0时每个测试用例在fork出的子进程中执行, 被测代码的静态变量和全局变量不会从上一个用例保留下来
+#define TEMPLATE_BATCH_STRING \
+"#include <stdio.h>\n" \
+"#include <stdlib.h>\n" \
+"#include <stdint.h>\n" \
+"#include <string.h>\n" \
+"#include <fcntl.h>\n" \
+"#include <unistd.h>\n" \
+"#include <errno.h>\n" \
+"#include <signal.h>\n" \
+"#include <sys/mman.h>\n" \
+"#include <sys/stat.h>\n" \
+"#include <sys/time.h>\n" \
+"#include <sys/wait.h>\n" \
+"\n" \
+"extern char __block_marker__[];\n" \
+"\n" \
+"static const unsigned char *batch_cur = NULL;\n" \
+"static const unsigned char *batch_end = NULL;\n" \
+"static int batch_out_fd = -1;\n" \
+"static size_t batch_marker_len = 0;\n" \
+"static int batch_cpu_limit = 0;\n" \
+"static volatile sig_atomic_t batch_in_case = 0;\n" \
+"static int batch_fork = 0;\n" \
+"static int batch_in_child = 0;\n" \
+"static volatile unsigned *batch_emitted = NULL;\n" \
+"\n" \
+"static int batch_load(int argc, char **argv) {\n" \
+"    if (argc > 1) {\n" \
+"        int fd = open(argv[1], O_RDONLY);\n" \
+"        struct stat st;\n" \
+"        if (fd < 0 || fstat(fd, &st) != 0) {\n" \
+"            return -1;\n" \
+"        }\n" \
+"        if (st.st_size == 0) {\n" \
+"            close(fd);\n" \
+"            return 0;\n" \
+"        }\n" \
+"        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);\n" \
+"        close(fd);\n" \
+"        if (data == MAP_FAILED) {\n" \
+"            return -1;\n" \
+"        }\n" \
+"        batch_cur = (const unsigned char *)data;\n" \
+"        batch_end = batch_cur + st.st_size;\n" \
+"        return 0;\n" \
+"    }\n" \
+"    size_t cap = 1 << 16, len = 0;\n" \
+"    unsigned char *buf = (unsigned char *)malloc(cap);\n" \
+"    ssize_t n;\n" \
+"    while ((n = read(0, buf + len, cap - len)) > 0) {\n" \
+"        len += n;\n" \
+"        if (len == cap) {\n" \
+"            cap *= 2;\n" \
+"            buf = (unsigned char *)realloc(buf, cap);\n" \
+"        }\n" \
+"    }\n" \
+"    batch_cur = buf;\n" \
+"    batch_end = buf + len;\n" \
+"    return 0;\n" \
+"}\n" \
+"\n" \
+"static int batch_read(void *dst, size_t n) {\n" \
+"    if ((size_t)(batch_end - batch_cur) < n) {\n" \
+"        return 0;\n" \
+"    }\n" \
+"    memcpy(dst, batch_cur, n);\n" \
+"    batch_cur += n;\n" \
+"    return 1;\n" \
+"}\n" \
+"\n" \
+"static int *batch_read_array(void) {\n" \
+"    uint32_t count = 0;\n" \
+"    batch_read(&count, sizeof(count));\n" \
+"    int *array = (int *)malloc((count + 1) * sizeof(int));\n" \
+"    batch_read(array, count * sizeof(int));\n" \
+"    return array;\n" \
+"}\n" \
+"\n" \
+"static char *batch_read_string(void) {\n" \
+"    uint32_t len = 0;\n" \
+"    batch_read(&len, sizeof(len));\n" \
+"    char *str = (char *)malloc(len + 1);\n" \
+"    batch_read(str, len);\n" \
+"    str[len] = '\\0';\n" \
+"    return str;\n" \
+"}\n" \
+"\n" \
+"static void batch_write(const void *buf, size_t n) {\n" \
+"    const char *p = (const char *)buf;\n" \
+"    while (n > 0) {\n" \
+"        ssize_t w = write(batch_out_fd, p, n);\n" \
+"        if (w <= 0) {\n" \
+"            return;\n" \
+"        }\n" \
+"        p += w;\n" \
+"        n -= w;\n" \
+"    }\n" \
+"}\n" \
+"\n" \
+"static void batch_reset_marker(void) {\n" \
+"    memset(__block_marker__, '0', batch_marker_len);\n" \
+"}\n" \
+"\n" \
+"static void batch_emit_record(unsigned char status) {\n" \
+"    unsigned char record[1 + (batch_marker_len + 7) / 8];\n" \
+"    memset(record, 0, sizeof(record));\n" \
+"    record[0] = status;\n" \
+"    for (size_t i = 0; i < batch_marker_len; i++) {\n" \
+"        if (__block_marker__[i] == '1') {\n" \
+"            record[1 + i / 8] |= (unsigned char)(1u << (i % 8));\n" \
+"        }\n" \
+"    }\n" \
+"    batch_write(record, sizeof(record));\n" \
+"    if (batch_emitted) {\n" \
+"        (*batch_emitted)++;\n" \
+"    }\n" \
+"}\n" \
+"\n" \
+"static void batch_on_signal(int sig) {\n" \
+"    if (batch_in_case) {\n" \
+"        batch_in_case = 0;\n" \
+"        batch_emit_record((unsigned char)sig);\n" \
+"    }\n" \
+"    raise(sig);\n" \
+"}\n" \
+"\n" \
+"static void batch_on_exit(void) {\n" \
+"    if (batch_in_case) {\n" \
+"        batch_in_case = 0;\n" \
+"        batch_emit_record(255);\n" \
+"    }\n" \
+"}\n" \
+"\n" \
+"static void batch_install_handlers(void) {\n" \
+"    static char alt_stack[1 << 16];\n" \
+"    stack_t ss;\n" \
+"    memset(&ss, 0, sizeof(ss));\n" \
+"    ss.ss_sp = alt_stack;\n" \
+"    ss.ss_size = sizeof(alt_stack);\n" \
+"    sigaltstack(&ss, NULL);\n" \
+"    struct sigaction sa;\n" \
+"    memset(&sa, 0, sizeof(sa));\n" \
+"    sa.sa_handler = batch_on_signal;\n" \
+"    sa.sa_flags = SA_ONSTACK | SA_RESETHAND;\n" \
+"    int sigs[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, SIGTERM, SIGXCPU, SIGPROF};\n" \
+"    for (int i = 0; i < (int)(sizeof(sigs) / sizeof(sigs[0])); i++) {\n" \
+"        sigaction(sigs[i], &sa, NULL);\n" \
+"    }\n" \
+"    atexit(batch_on_exit);\n" \
+"}\n" \
+"\n" \
+"/* 每个测试用例单独计算CPU时间, 超过后收到SIGPROF */\n" \
+"static void batch_set_cpu_timer(int seconds) {\n" \
+"    struct itimerval it;\n" \
+"    memset(&it, 0, sizeof(it));\n" \
+"    it.it_value.tv_sec = seconds;\n" \
+"    setitimer(ITIMER_PROF, &it, NULL);\n" \
+"}\n" \
+"\n" \
+"/* fork模式下父进程返回1, 等待子进程执行完当前用例; 子进程没有写出记录(如被SIGKILL杀死)时由父进程补上。\n" \
+" * 子进程和不使用fork时返回0, 在当前进程中执行用例 */\n" \
+"static int batch_fork_case(void) {\n" \
+"    if (!batch_fork) {\n" \
+"        return 0;\n" \
+"    }\n" \
+"    *batch_emitted = 0;\n" \
+"    pid_t pid = fork();\n" \
+"    if (pid < 0) {\n" \
+"        return 0;\n" \
+"    }\n" \
+"    if (pid == 0) {\n" \
+"        batch_in_child = 1;\n" \
+"        return 0;\n" \
+"    }\n" \
+"    int status = 0;\n" \
+"    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {\n" \
+"    }\n" \
+"    if (*batch_emitted == 0) {\n" \
+"        batch_reset_marker();\n" \
+"        batch_emit_record(WIFSIGNALED(status) ? (unsigned char)WTERMSIG(status) : 255);\n" \
+"    }\n" \
+"    return 1;\n" \
+"}\n"
+
+#define TEMPLATE_BATCH_MAIN_STRING \
+"int main(int argc, char** argv){\n" \
+"    batch_out_fd = dup(1);\n" \
+"    close(1);\n" \
+"    if (batch_load(argc, argv) != 0) {\n" \
+"        return 1;\n" \
+"    }\n" \
+"    batch_marker_len = strlen(__block_marker__);\n" \
+"    batch_cpu_limit = argc > 2 ? atoi(argv[2]) : 0;\n" \
+"    batch_fork = argc > 3 && atoi(argv[3]) != 0;\n" \
+"    if (batch_fork) {\n" \
+"        void *shared = mmap(NULL, sizeof(*batch_emitted), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);\n" \
+"        batch_fork = shared != MAP_FAILED;\n" \
+"        batch_emitted = batch_fork ? (volatile unsigned *)shared : NULL;\n" \
+"    }\n" \
+"    batch_install_handlers();\n" \
+"    uint32_t block_count = (uint32_t)batch_marker_len;\n" \
+"    batch_write(&block_count, sizeof(block_count));\n" \
+"    while (batch_cur < batch_end) {\n" \
+"        uint32_t case_size = 0;\n" \
+"        if (!batch_read(&case_size, sizeof(case_size)) || (size_t)(batch_end - batch_cur) < case_size) {\n" \
+"            break;\n" \
+"        }\n" \
+"        const unsigned char *case_end = batch_cur + case_size;\n" \
+"        if (batch_fork_case()) {\n" \
+"            batch_cur = case_end;\n" \
+"            continue;\n" \
+"        }\n"
+#define TEMPLATE_BATCH_END_STRING \
+"        batch_in_case = 0;\n" \
+"        batch_set_cpu_timer(0);\n" \
+"        batch_emit_record(0);\n" \
+"        if (batch_in_child) {\n" \
+"            _exit(0);\n" \
+"        }\n" \
+"        batch_cur = case_end;\n" \
+"    }\n" \
+"    return 0;\n" \
+"}\n"
+
 #define KLEE_INCLUDE_STRING "#include <klee/klee.h>\n"
 #define KLEE_MAIN_STRING "int main(){\n"
 #define KLEE_END_STRING "    return 0;\n}\n"
@@ -181,20 +456,65 @@ bool readLinesFromFile(const std::string& filepath, std::vector<std::string>& li
     return true;
 }
 
-bool compileSrcToIR(std::string srcFile, std::string irFile){
-    std::string cmd = COMPILER + IR_COMPILE_OPTIONS + srcFile + " -o " + irFile;
-    int ret = system(cmd.c_str());
-    return ret == 0;
+// 文件内容与content不同时才写入: 先写到同目录下的临时文件再替换, 读取这个文件的其它进程和线程不会看到写了一半的内容
+bool writeFileIfChanged(const std::string& file, const std::string& content){
+    {
+        std::ifstream fin(file, std::ios::binary);
+        if(fin){
+            std::string old((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+            if(old == content){
+                return true;
+            }
+        }
+    }
+    static std::atomic<unsigned> counter {0};
+    std::string tmpFile = file + ".tmp" + std::to_string(getpid()) + "_" + std::to_string(counter++);
+    std::ofstream fout(tmpFile, std::ios::binary);
+    if(!fout){
+        return false;
+    }
+    fout.write(content.data(), static_cast<std::streamsize>(content.size()));
+    fout.close();
+    std::error_code ec;
+    std::filesystem::rename(tmpFile, file, ec);
+    if(ec){
+        std::filesystem::remove(tmpFile, ec);
+        return false;
+    }
+    return true;
 }
 
-bool compileIRToExec(std::string irFile, std::string execFile){
-    std::string cmd = COMPILER + irFile + " -o " + execFile;
+// target存在并且不比source旧
+bool isUpToDate(const std::string& target, const std::string& source){
+    std::error_code ec1, ec2;
+    auto targetTime = std::filesystem::last_write_time(target, ec1);
+    auto sourceTime = std::filesystem::last_write_time(source, ec2);
+    return !ec1 && !ec2 && targetTime >= sourceTime;
+}
+
+// 按源文件所在目录附加的编译选项, 由Workspace在复制源文件时设置
+std::mutex dirCompileFlagsMutex;
+std::map<std::string, std::string> dirCompileFlags;
+
+void setDirCompileFlags(const std::string& dir, const std::string& flags){
+    std::lock_guard<std::mutex> lock(dirCompileFlagsMutex);
+    dirCompileFlags[dir] = flags;
+}
+
+std::string getDirCompileFlags(const std::string& file){
+    std::lock_guard<std::mutex> lock(dirCompileFlagsMutex);
+    auto it = dirCompileFlags.find(getDirPath(file));
+    return it == dirCompileFlags.end() ? "" : it->second + " ";
+}
+
+bool compileSrcToIR(std::string srcFile, std::string irFile){
+    std::string cmd = COMPILER + IR_COMPILE_OPTIONS + getDirCompileFlags(srcFile) + srcFile + " -o " + irFile;
     int ret = system(cmd.c_str());
     return ret == 0;
 }
 
-bool cleanUselessFiles(){
-    std::string cmd = CLEAN_SCRIPT;
+bool compileIRToExec(std::string irFile, std::string execFile, bool optimize = false){
+    std::string cmd = COMPILER + (optimize ? EXEC_OPTIMIZE_OPTIONS : "") + irFile + " -o " + execFile;
     int ret = system(cmd.c_str());
     return ret == 0;
 }
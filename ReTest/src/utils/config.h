@@ -6,13 +6,59 @@
 #define INVALID_PATH_ID -1
 #define SIMILARITY_THRESHOLD 0.35
 #define KLEE_ARRAY_SIZE 5
+#define BATCH_MIN_CASES 64  // 批量驱动每个进程至少执行的测试用例数
+#define BATCH_STATUS_EXIT 255   // 批量驱动中被测函数调用exit时的记录状态
+#define EXEC_TIMEOUT_MS 10000   // 单个测试用例的墙钟超时
+#define EXEC_CPU_LIMIT_SEC 10   // 单个测试用例的CPU时间上限
+#define EXEC_MEMORY_LIMIT_MB 2048   // 测试进程的地址空间上限
+#define KLEE_TIMEOUT_SEC 10     // 每个KLEE任务的-max-time
+#define KLEE_KILL_GRACE_SEC 5   // KLEE超过-max-time后仍未退出时, 再等待这么久后强制结束
+#define KLEE_MEMORY_MB 2000     // 每个KLEE任务的-max-memory, 也用来估算能同时运行的任务数
+#define KLEE_TARGETS_PER_JOB 8  // 每个KLEE任务同时搜索的目标路径数
+#define KLEE_SEEDS_PER_PATH 2   // 每条目标路径作为KLEE种子的复用测试用例数
+#define KLEE_MIN_TIME_SEC 2     // 有全局时间预算时每个KLEE任务至少分配的时间
+#define KLEE_MAX_ATTEMPTS 2     // 有全局时间预算时一条路径最多被KLEE搜索的次数
+#define KLEE_WEIGHT_PER_BLOCK 0.25  // 估计路径难度时每个基本块的权重, 每个条件分支的权重为1
+#define FUZZ_ROUNDS 16          // 变异测试的默认轮数
+#define FUZZ_BATCH_SIZE 256     // 每轮执行的变异体个数
+#define FUZZ_SEEDS_PER_ROUND 8  // 每轮参与变异的语料个数
+#define FUZZ_MAX_DELTA 16       // 整数加减变异的最大幅度
+#define FUZZ_MAX_STRING 64      // 变异得到的字符串的最大长度
+#define FUZZ_RANDOM_SEED 20231  // 固定的随机数种子, 使变异结果可以复现
+#define SERVER_MAX_REQUEST_BYTES (1 << 20)  // 常驻进程接受的一行请求的最大长度
+#define SERVER_IDLE_TIMEOUT_MS 30000       // 连接在两个请求之间的最长空闲时间, 超过后常驻进程关闭连接
 
 const std::string COMPILER = "clang-13 ";
 const std::string IR_COMPILE_OPTIONS = " -S -emit-llvm -g ";
+const std::string EXEC_OPTIMIZE_OPTIONS = " -O2 ";
 
-const std::string KLEE_SCRIPT = "../scripts/klee_ir.py ";
+const std::string KLEE_BIN = "klee";
 const std::string IR2PNG_SCRIPT = "../scripts/ir2png.py ";
-const std::string CLEAN_SCRIPT = "../scripts/clean.py ";
+const std::string WORKSPACE_DIR = "/dev/shm";  // 工作区默认放在tmpfs上, 不可用时放在系统临时目录中
+const std::string WORKSPACE_PREFIX_MAP = "/pctrt-workspace";    // 调试信息中工作区路径的替换, 使可执行文件的内容与工作区的位置无关
 
+namespace PCTRT {
+// 运行时选项，由main中的命令行参数填充后传给各个引擎
+struct RuntimeOptions {
+    bool optimizeExec {false};  // 插桩后的可执行文件是否开启编译优化
+    bool minimalProbes {false}; // 是否只在必要的基本块中插桩, 其余基本块的覆盖情况在运行后还原
+    bool batchDriver {false};   // 是否使用批量驱动在一个进程中执行所有测试用例
+    size_t execParallel {0};    // 同时运行的测试进程数, 0表示CPU核数
+    int execTimeoutMs {EXEC_TIMEOUT_MS};    // 单个测试用例的墙钟超时, 0表示不限制
+    int execCpuSeconds {EXEC_CPU_LIMIT_SEC};    // 单个测试用例的CPU时间上限, 0表示不限制
+    size_t execMemoryMB {EXEC_MEMORY_LIMIT_MB}; // 测试进程的地址空间上限, 0表示不限制
+    std::string kleeBin {KLEE_BIN};    // KLEE可执行文件
+    size_t kleeParallel {0};    // 同时运行的KLEE任务数, 0表示按CPU核数和内存估算
+    int kleeTimeoutSec {KLEE_TIMEOUT_SEC};  // 每条目标路径的KLEE时间上限, 一个任务的上限按目标路径数累加
+    size_t kleeTargetsPerJob {KLEE_TARGETS_PER_JOB};    // 每个KLEE任务同时搜索的目标路径数
+    size_t kleeSeeds {KLEE_SEEDS_PER_PATH};    // 每条目标路径的KLEE种子数, 0表示不使用种子
+    int generateBudgetSec {0};     // 测试生成阶段的全局时间预算(秒), 0表示不限制, 每条路径使用固定的kleeTimeoutSec
+    bool fastSolve {true};         // 运行KLEE前先用PathSolver求解只含简单分支条件的路径
+    bool pruneInfeasible {true};   // 运行KLEE前去掉静态分析证明不可行的路径
+    size_t fuzzRounds {FUZZ_ROUNDS};    // 运行KLEE前的变异测试轮数, 0表示不进行变异测试
+    std::string execCacheFile;  // 执行结果缓存文件, 为空时放在测试套件文件旁边, 为"none"时不使用缓存
+    size_t jobParallel {0};     // 同时处理的函数数, 0表示CPU核数
+};
+} // namespace PCTRT
 
 #endif
\ No newline at end of file
@@ -0,0 +1,99 @@
+#ifndef PCTRT_MODULECACHE_H
+#define PCTRT_MODULECACHE_H
+
+#include <map>
+#include <mutex>
+#include <future>
+#include <memory>
+#include <string>
+#include <iostream>
+#include <filesystem>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include "utils/common.h"
+
+namespace PCTRT
+{
+
+/**
+ * ModuleCache: 一次运行中共享的编译结果和解析后的llvm::Module
+ * 源文件到IR文件的编译按(源文件, IR文件, 源文件修改时间)只进行一次, 多个函数、多个线程共用编译结果,
+ * 并发请求同一个编译时后来者等待第一次编译结束。
+ * llvm::LLVMContext不能跨线程使用, 解析后的Module按线程缓存, 每个线程对每个IR文件只解析一次,
+ * IR文件被改写(修改时间变化)后重新解析。缓存的Module只能读, 需要修改IR的地方仍然自己解析。
+ */
+class ModuleCache {
+private:
+    struct ParsedModule {
+        long long stamp {0};
+        std::unique_ptr<llvm::Module> module;
+    };
+
+    // 每个线程的LLVMContext和在其中解析的Module, Context必须比Module晚析构
+    struct ThreadModules {
+        llvm::LLVMContext ctx;
+        std::map<std::string, ParsedModule> modules;
+    };
+
+    inline static std::mutex compileMutex;
+    inline static std::map<std::string, std::shared_future<bool>> compiled;
+
+    static ThreadModules& threadModules(){
+        thread_local ThreadModules modules;
+        return modules;
+    }
+
+public:
+    // 文件的修改时间, 用作缓存是否过期的标记, 文件不存在时为0
+    static long long modifyTime(const std::string& file){
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(file, ec);
+        return ec ? 0 : static_cast<long long>(time.time_since_epoch().count());
+    }
+
+    static bool compile(const std::string& srcFile, const std::string& irFile){
+        std::string key = srcFile + "\n" + irFile + "\n" + std::to_string(modifyTime(srcFile));
+        std::promise<bool> promise;
+        std::shared_future<bool> result;
+        bool owner = false;
+        {
+            std::lock_guard<std::mutex> lock(compileMutex);
+            auto it = compiled.find(key);
+            if(it == compiled.end()){
+                result = promise.get_future().share();
+                compiled.emplace(key, result);
+                owner = true;
+            }else{
+                result = it->second;
+            }
+        }
+        if(owner){
+            promise.set_value(compileSrcToIR(srcFile, irFile));
+        }
+        return result.get();
+    }
+
+    // 当前线程中irFile对应的Module, 解析失败时返回nullptr
+    static llvm::Module* get(const std::string& irFile){
+        auto& local = threadModules();
+        long long stamp = modifyTime(irFile);
+        auto& parsed = local.modules[irFile];
+        if(parsed.module && parsed.stamp == stamp){
+            return parsed.module.get();
+        }
+        llvm::SMDiagnostic err;
+        parsed.module = llvm::parseIRFile(irFile, err, local.ctx);
+        parsed.stamp = stamp;
+        if(!parsed.module){
+            std::cout << "Parse IR file " << irFile << " failed" << std::endl;
+        }
+        return parsed.module.get();
+    }
+};
+
+} // namespace PCTRT
+
+#endif //PCTRT_MODULECACHE_H
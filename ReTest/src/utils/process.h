@@ -0,0 +1,434 @@
+#ifndef PCTRT_PROCESS_H
+#define PCTRT_PROCESS_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <thread>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <pthread.h>
+
+#include "utils/common.h"
+
+extern char **environ;
+
+namespace PCTRT
+{
+
+#define PROCESS_READ_CHUNK (64 * 1024)
+#define PROCESS_OUTPUT_RESERVE 256
+#define PROCESS_KILL_GRACE_MS 200   // 超时后先发送SIGTERM, 宽限期过后再发送SIGKILL
+#define PROCESS_REAP_INTERVAL_MS 10 // 管道已关闭但子进程还没有退出时, 检查子进程是否退出的间隔
+
+// 子进程的资源限制, 值为0表示不限制
+struct ProcessLimits {
+    int timeoutMs {0};          // 从启动开始计算的墙钟超时
+    int idleTimeoutMs {0};      // 从最后一次输出开始计算的墙钟超时
+    int cpuSeconds {0};         // RLIMIT_CPU
+    size_t memoryMB {0};        // RLIMIT_AS
+    bool noCoreDump {true};     // RLIMIT_CORE置为0
+    bool discardStderr {false}; // 标准错误重定向到/dev/null
+};
+
+struct ProcessResult {
+    std::string output;         // 标准输出
+    int exitCode {-1};          // 正常退出时的返回值
+    int termSignal {0};         // 被信号终止时的信号
+    bool cancelled {false};     // 是否被取消
+    bool timedOut {false};      // 是否因为超时被杀死
+};
+
+/**
+ * ProcessPool: 基于vfork和epoll的进程池
+ * 子进程直接以argv启动(不经过shell), 标准输出通过非阻塞管道读取,
+ * 一个线程通过epoll同时监视所有运行中的子进程, 同时运行的进程数不超过maxParallel。
+ * 回调在poll()所在线程中执行, 回调中可以继续submit或cancel。
+ * 子进程与glibc的posix_spawn一样由vfork创建, 不复制父进程的页表; 资源限制在子进程exec之前用setrlimit设置,
+ * 被测程序从第一条指令开始就受限制, 墙钟超时由事件循环负责。
+ * 每个子进程位于自己的进程组中, 超时和取消时杀死整个进程组, 继承了管道的孙进程不会让读端一直等不到EOF。
+ * 子进程用WNOHANG回收, 读到EOF后仍在运行的子进程继续按超时时间点处理, 不会阻塞事件循环。
+ */
+class ProcessPool {
+public:
+    using Callback = std::function<void(size_t, ProcessResult&)>;
+    using Clock = std::chrono::steady_clock;
+
+private:
+    struct Job {
+        std::vector<std::string> argv;
+        Callback onExit;
+        ProcessLimits limits;
+        bool done {false};
+    };
+
+    struct Running {
+        pid_t pid {-1};             // 子进程pid, 同时也是其进程组id
+        int fd {-1};                // 管道读端, 读到EOF后关闭并置为-1
+        bool exited {false};        // 子进程是否已经被回收
+        size_t jobId {0};
+        ProcessResult result;
+        Clock::time_point wallDeadline {Clock::time_point::max()};
+        Clock::time_point idleDeadline {Clock::time_point::max()};
+        Clock::time_point killAt {Clock::time_point::max()};
+    };
+
+    size_t maxParallel;
+    int epfd {-1};
+    std::vector<Job> jobs;
+    std::deque<size_t> queue;
+    std::unordered_map<pid_t, Running> running; // 子进程pid -> 运行中的子进程
+    std::vector<char> buffer;                   // 预分配的读缓冲区
+    std::vector<epoll_event> events;
+
+public:
+    explicit ProcessPool(size_t parallel = 0)
+        : maxParallel(parallel > 0 ? parallel : defaultParallelism())
+        , buffer(PROCESS_READ_CHUNK)
+        {
+            epfd = epoll_create1(EPOLL_CLOEXEC);
+            PCTRT_ASSERT(epfd >= 0, "Cannot create epoll instance.");
+        }
+
+    ~ProcessPool() {
+        for(auto& [pid, proc] : running){
+            kill(-pid, SIGKILL);
+            if(!proc.exited){
+                waitpid(pid, nullptr, 0);
+            }
+            if(proc.fd >= 0){
+                close(proc.fd);
+            }
+        }
+        close(epfd);
+    }
+
+    ProcessPool(const ProcessPool&) = delete;
+    ProcessPool& operator=(const ProcessPool&) = delete;
+
+    static size_t defaultParallelism() {
+        size_t cores = std::thread::hardware_concurrency();
+        return cores > 0 ? cores : 1;
+    }
+
+    size_t submit(std::vector<std::string> argv, Callback onExit = nullptr, const ProcessLimits& limits = {}) {
+        PCTRT_ASSERT(!argv.empty(), "Cannot spawn a process without argv.");
+        jobs.push_back({std::move(argv), std::move(onExit), limits});
+        queue.push_back(jobs.size() - 1);
+        return jobs.size() - 1;
+    }
+
+    // 取消任务: 排队中的任务直接移除, 运行中的任务被杀死
+    void cancel(size_t jobId) {
+        if(jobId >= jobs.size() || jobs[jobId].done){
+            return;
+        }
+        for(auto it = queue.begin(); it != queue.end(); ++it){
+            if(*it == jobId){
+                queue.erase(it);
+                ProcessResult result;
+                result.cancelled = true;
+                finish(jobId, result);
+                return;
+            }
+        }
+        for(auto& [pid, proc] : running){
+            if(proc.jobId == jobId){
+                proc.result.cancelled = true;
+                kill(-pid, SIGKILL);
+                return;
+            }
+        }
+    }
+
+    [[nodiscard]] bool idle() const {
+        return queue.empty() && running.empty();
+    }
+
+    [[nodiscard]] size_t inFlight() const {
+        return running.size();
+    }
+
+    // 启动排队的任务并处理一轮事件, timeoutMs为-1时一直等待
+    void poll(int timeoutMs = -1) {
+        fillSlots();
+        if(running.empty()){
+            return;
+        }
+        events.resize(running.size());
+        int n = epoll_wait(epfd, events.data(), static_cast<int>(events.size()), waitTimeout(timeoutMs));
+        if(n < 0){
+            PCTRT_ASSERT(errno == EINTR, "epoll_wait failed.");
+            return;
+        }
+        for(int i = 0; i < n; ++i){
+            drain(static_cast<pid_t>(events[i].data.u64));
+        }
+        reap();
+        checkDeadlines();
+        fillSlots();
+    }
+
+    void wait() {
+        while(!idle()){
+            poll();
+        }
+    }
+
+private:
+    void fillSlots() {
+        while(running.size() < maxParallel && !queue.empty()){
+            size_t jobId = queue.front();
+            queue.pop_front();
+            if(!spawn(jobId)){
+                ProcessResult result;
+                finish(jobId, result);
+            }
+        }
+    }
+
+    bool spawn(size_t jobId) {
+        const auto& limits = jobs[jobId].limits;
+        std::string path = findExecutable(jobs[jobId].argv.front());
+        int fds[2];
+        if(pipe2(fds, O_CLOEXEC) != 0){
+            std::cout << "Cannot create pipe for: " << jobs[jobId].argv.front() << std::endl;
+            return false;
+        }
+        // 子进程中只调用系统调用, 所有参数在vfork之前准备好
+        std::vector<char*> argv;
+        for(auto& arg : jobs[jobId].argv){
+            argv.push_back(arg.data());
+        }
+        argv.push_back(nullptr);
+        std::vector<std::pair<int, rlimit>> rlimits = collectLimits(limits);
+        // vfork的子进程与父进程共用内存, 在exec之前不能运行父进程的信号处理函数
+        sigset_t all, old;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        volatile int childErrno = 0;
+        pid_t pid = vfork();
+        if(pid == 0){
+            runChild(path.c_str(), argv.data(), fds[1], limits.discardStderr, rlimits, old, childErrno);
+        }
+        int spawnErrno = pid < 0 ? errno : childErrno;
+        pthread_sigmask(SIG_SETMASK, &old, nullptr);
+        close(fds[1]);
+        if(pid > 0 && spawnErrno != 0){
+            waitpid(pid, nullptr, 0);
+        }
+        if(pid < 0 || spawnErrno != 0){
+            std::cout << "Cannot execute command: " << jobs[jobId].argv.front() << ": " << strerror(spawnErrno) << std::endl;
+            close(fds[0]);
+            return false;
+        }
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = static_cast<uint64_t>(pid);
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev);
+        Running proc;
+        proc.pid = pid;
+        proc.fd = fds[0];
+        proc.jobId = jobId;
+        proc.result.output.reserve(PROCESS_OUTPUT_RESERVE);
+        proc.wallDeadline = afterMs(limits.timeoutMs);
+        proc.idleDeadline = afterMs(limits.idleTimeoutMs);
+        running.emplace(pid, std::move(proc));
+        return true;
+    }
+
+    // vfork出的子进程: 进入自己的进程组, 重定向标准输入输出, 设置资源限制后exec; exec失败时通过共用的内存报告errno
+    [[noreturn]] static void runChild(const char* path, char* const* argv, int outFd, bool discardStderr,
+                                      const std::vector<std::pair<int, rlimit>>& rlimits, const sigset_t& mask,
+                                      volatile int& childErrno) {
+        setpgid(0, 0);
+        int devNull = open("/dev/null", O_RDWR | O_CLOEXEC);
+        if(devNull < 0 || dup2(devNull, 0) < 0 || dup2(outFd, 1) < 0 || (discardStderr && dup2(devNull, 2) < 0)){
+            childErrno = errno;
+            _exit(127);
+        }
+        for(const auto& [resource, lim] : rlimits){
+            if(setrlimit(resource, &lim) != 0){
+                childErrno = errno;
+                _exit(127);
+            }
+        }
+        // 父进程设置的信号处理函数恢复为默认, 再恢复父进程原来的信号屏蔽字
+        for(int sig = 1; sig < NSIG; ++sig){
+            struct sigaction action {};
+            if(sigaction(sig, nullptr, &action) == 0 && action.sa_handler != SIG_DFL && action.sa_handler != SIG_IGN){
+                action.sa_handler = SIG_DFL;
+                action.sa_flags = 0;
+                sigaction(sig, &action, nullptr);
+            }
+        }
+        sigprocmask(SIG_SETMASK, &mask, nullptr);
+        execve(path, argv, environ);
+        childErrno = errno;
+        _exit(127);
+    }
+
+    static std::vector<std::pair<int, rlimit>> collectLimits(const ProcessLimits& limits) {
+        std::vector<std::pair<int, rlimit>> rlimits;
+        if(limits.cpuSeconds > 0){
+            rlimits.push_back({RLIMIT_CPU, {static_cast<rlim_t>(limits.cpuSeconds), static_cast<rlim_t>(limits.cpuSeconds + 1)}});
+        }
+        if(limits.memoryMB > 0){
+            rlimits.push_back({RLIMIT_AS, {static_cast<rlim_t>(limits.memoryMB) << 20, static_cast<rlim_t>(limits.memoryMB) << 20}});
+        }
+        if(limits.noCoreDump){
+            rlimits.push_back({RLIMIT_CORE, {0, 0}});
+        }
+        return rlimits;
+    }
+
+    // 不含'/'的命令在PATH中查找, 找不到时原样返回, 由execve报告错误
+    static std::string findExecutable(const std::string& name) {
+        if(name.find('/') != std::string::npos){
+            return name;
+        }
+        const char* env = getenv("PATH");
+        std::string paths = env ? env : "/usr/local/bin:/usr/bin:/bin";
+        size_t begin = 0;
+        while(begin <= paths.size()){
+            size_t end = std::min(paths.find(':', begin), paths.size());
+            std::string dir = end > begin ? paths.substr(begin, end - begin) : ".";
+            std::string candidate = dir + "/" + name;
+            if(access(candidate.c_str(), X_OK) == 0){
+                return candidate;
+            }
+            begin = end + 1;
+        }
+        return name;
+    }
+
+    static Clock::time_point afterMs(int ms) {
+        return ms > 0 ? Clock::now() + std::chrono::milliseconds(ms) : Clock::time_point::max();
+    }
+
+    // epoll_wait的等待时间不能超过最近的一个超时时间点; 有管道已关闭的子进程时还要定期回收
+    int waitTimeout(int timeoutMs) const {
+        auto nearest = Clock::time_point::max();
+        for(const auto& [pid, proc] : running){
+            nearest = std::min({nearest, proc.wallDeadline, proc.idleDeadline, proc.killAt});
+            if(proc.fd < 0){
+                nearest = std::min(nearest, Clock::now() + std::chrono::milliseconds(PROCESS_REAP_INTERVAL_MS));
+            }
+        }
+        if(nearest == Clock::time_point::max()){
+            return timeoutMs;
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(nearest - Clock::now()).count() + 1;
+        ms = std::max<long long>(ms, 0);
+        return timeoutMs < 0 ? static_cast<int>(ms) : static_cast<int>(std::min<long long>(ms, timeoutMs));
+    }
+
+    void checkDeadlines() {
+        auto now = Clock::now();
+        for(auto& [pid, proc] : running){
+            if(now >= proc.killAt){
+                kill(-pid, SIGKILL);
+                proc.killAt = Clock::time_point::max();
+            }else if(now >= proc.wallDeadline || now >= proc.idleDeadline){
+                // 先发送SIGTERM, 让驱动有机会输出已覆盖的基本块
+                kill(-pid, SIGTERM);
+                proc.result.timedOut = true;
+                proc.wallDeadline = Clock::time_point::max();
+                proc.idleDeadline = Clock::time_point::max();
+                proc.killAt = now + std::chrono::milliseconds(PROCESS_KILL_GRACE_MS);
+            }
+        }
+    }
+
+    // 读取管道中所有可读的数据, 读到EOF时关闭读端
+    void drain(pid_t pid) {
+        auto it = running.find(pid);
+        if(it == running.end() || it->second.fd < 0){
+            return;
+        }
+        Running& proc = it->second;
+        while(true){
+            ssize_t n = read(proc.fd, buffer.data(), buffer.size());
+            if(n > 0){
+                proc.result.output.append(buffer.data(), n);
+                if(!proc.result.timedOut){
+                    proc.idleDeadline = afterMs(jobs[proc.jobId].limits.idleTimeoutMs);
+                }
+                continue;
+            }
+            if(n < 0 && errno == EINTR){
+                continue;
+            }
+            if(n < 0 && errno == EAGAIN){
+                return;
+            }
+            break;
+        }
+        epoll_ctl(epfd, EPOLL_CTL_DEL, proc.fd, nullptr);
+        close(proc.fd);
+        proc.fd = -1;
+    }
+
+    // 非阻塞地回收已经退出的子进程。子进程退出后管道仍未关闭, 说明有孙进程持有写端,
+    // 读出剩余的数据后杀死整个进程组。子进程已回收且管道已关闭的任务结束。
+    void reap() {
+        std::vector<pid_t> finished;
+        for(auto& [pid, proc] : running){
+            if(!proc.exited){
+                int status = 0;
+                pid_t ret = waitpid(pid, &status, WNOHANG);
+                if(ret != pid){
+                    continue;
+                }
+                proc.exited = true;
+                if(WIFEXITED(status)){
+                    proc.result.exitCode = WEXITSTATUS(status);
+                }else if(WIFSIGNALED(status)){
+                    proc.result.termSignal = WTERMSIG(status);
+                }
+            }
+            if(proc.fd >= 0){
+                drain(pid);
+            }
+            if(proc.fd >= 0){
+                kill(-pid, SIGKILL);
+                epoll_ctl(epfd, EPOLL_CTL_DEL, proc.fd, nullptr);
+                close(proc.fd);
+                proc.fd = -1;
+            }
+            finished.push_back(pid);
+        }
+        for(pid_t pid : finished){
+            Running proc = std::move(running.at(pid));
+            running.erase(pid);
+            finish(proc.jobId, proc.result);
+        }
+    }
+
+    void finish(size_t jobId, ProcessResult& result) {
+        jobs[jobId].done = true;
+        jobs[jobId].argv.clear();
+        // 回调中可能会submit新任务导致jobs扩容, 所以先把回调移出来
+        Callback onExit = std::move(jobs[jobId].onExit);
+        if(onExit){
+            onExit(jobId, result);
+        }
+    }
+};
+
+} // namespace PCTRT
+
+#endif //PCTRT_PROCESS_H
@@ -0,0 +1,157 @@
+#ifndef PCTRT_WORKSPACE_H
+#define PCTRT_WORKSPACE_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <functional>
+#include <filesystem>
+#include <unistd.h>
+
+#include "utils/common.h"
+#include "utils/config.h"
+
+namespace PCTRT
+{
+
+/**
+ * Workspace: 一次运行独占的临时目录
+ * 被测源文件先复制到工作区中, 之后的IR、驱动、插桩后的可执行文件以及KLEE的输入输出都生成在副本旁边,
+ * 同一台机器上的多个运行互不干扰, 被测源文件本身也不会被修改。
+ * 每个源文件复制到以它原路径的哈希命名的子目录中, 编译副本时从原目录查找包含的头文件,
+ * 调试信息中的工作区路径被替换为固定的路径, 插桩后的可执行文件在不同运行之间保持一致, 执行结果缓存仍然有效。
+ * 工作区默认放在tmpfs(/dev/shm)上, 对象析构时整个删除; 设置keep时保留以便调试。
+ */
+class Workspace {
+public:
+    using Prepare = std::function<void(const std::string&)>;
+
+private:
+    std::string root;
+    bool keep {false};
+    std::mutex mtx;
+    struct StagedFile {
+        std::string copy;
+        std::string version;    // 复制时原文件的大小和修改时间
+    };
+    std::map<std::string, StagedFile> staged;   // 原路径 -> 工作区中的副本
+
+public:
+    explicit Workspace(const std::string& baseDir = ""){
+        std::vector<std::string> candidates;
+        if(!baseDir.empty()){
+            candidates.push_back(baseDir);
+        }else{
+            candidates.push_back(WORKSPACE_DIR);
+            std::error_code ec;
+            candidates.push_back(std::filesystem::temp_directory_path(ec).string());
+        }
+        for(const auto& dir : candidates){
+            if(dir.empty() || access(dir.c_str(), W_OK | X_OK) != 0){
+                continue;
+            }
+            std::string pattern = dir + "/pctrt-XXXXXX";
+            if(mkdtemp(pattern.data()) != nullptr){
+                root = pattern;
+                break;
+            }
+        }
+        if(root.empty()){
+            std::cout << "Cannot create workspace in " << (baseDir.empty() ? WORKSPACE_DIR : baseDir) << std::endl;
+        }
+    }
+
+    ~Workspace(){
+        if(root.empty()){
+            return;
+        }
+        if(keep){
+            std::cout << "Workspace kept at " << root << std::endl;
+            return;
+        }
+        std::error_code ec;
+        std::filesystem::remove_all(root, ec);
+    }
+
+    Workspace(const Workspace&) = delete;
+    Workspace& operator=(const Workspace&) = delete;
+
+    [[nodiscard]] bool valid() const {
+        return !root.empty();
+    }
+
+    [[nodiscard]] const std::string& getRoot() const {
+        return root;
+    }
+
+    void setKeep(bool keepFiles){
+        this->keep = keepFiles;
+    }
+
+    // 把源文件复制到工作区, 返回副本的路径, 失败时返回空字符串。
+    // 同一个源文件只复制一次, 原文件被修改(修改时间或大小变化)后重新复制, 常驻进程中总是使用最新的版本;
+    // prepare在复制后、副本对其它线程可见之前调用
+    std::string stage(const std::string& srcFile, const Prepare& prepare = nullptr){
+        std::error_code ec;
+        std::string origin = std::filesystem::weakly_canonical(srcFile, ec).string();
+        if(ec){
+            origin = srcFile;
+        }
+        std::string version = originVersion(origin);
+        std::lock_guard<std::mutex> lock(mtx);
+        if(auto it = staged.find(origin); it != staged.end() && it->second.version == version){
+            return it->second.copy;
+        }
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for(char c : origin){
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 0x100000001b3ULL;
+        }
+        char name[17];
+        snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+        std::string dir = root + "/" + name;
+        std::string copy = dir + "/" + std::filesystem::path(srcFile).filename().string();
+        std::string tmp = copy + ".staging";
+        std::filesystem::create_directories(dir, ec);
+        if(ec || !std::filesystem::copy_file(origin, tmp, std::filesystem::copy_options::overwrite_existing, ec)){
+            std::cout << "Cannot copy " << srcFile << " to workspace " << root << std::endl;
+            return {};
+        }
+        setDirCompileFlags(getDirPath(copy), "-iquote " + getDirPath(origin) + " -ffile-prefix-map=" + root + "=" + WORKSPACE_PREFIX_MAP);
+        if(prepare){
+            prepare(tmp);
+        }
+        // 内容没有变化时保留副本原来的修改时间, 之前的IR和可执行文件仍然可用
+        std::string content;
+        {
+            std::ifstream fin(tmp, std::ios::binary);
+            content.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+        }
+        std::filesystem::remove(tmp, ec);
+        if(!writeFileIfChanged(copy, content)){
+            std::cout << "Cannot copy " << srcFile << " to workspace " << root << std::endl;
+            return {};
+        }
+        staged[origin] = {copy, version};
+        return copy;
+    }
+
+private:
+    static std::string originVersion(const std::string& file){
+        std::error_code ec;
+        auto size = std::filesystem::file_size(file, ec);
+        auto time = std::filesystem::last_write_time(file, ec);
+        return std::to_string(size) + ":" + std::to_string(time.time_since_epoch().count());
+    }
+};
+
+} // namespace PCTRT
+
+#endif //PCTRT_WORKSPACE_H